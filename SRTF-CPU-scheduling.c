@@ -1,480 +1,4188 @@
-/*******************************************************************************
- * 
- * Project: SRTF CPU Scheduling
- * 
- * Authors:
- * Jack Romanous
- * 
- * Compile instructions:
- * Ensure that gcc is installed and run the following command:
- * gcc -Wall -O2 SRTF-CPU-scheduling.c -o SRTF-CPU-scheduling -lpthread -lrt
- * 
- * Notes:
- * The input data of the cpu scheduling algorithm is:
- * --------------------------------------------------------
- *     Process ID           Arrive time          Burst time
- *              1                     8                  10
- *              2                    10                   3
- *              3                    14                   7
- *              4                     9                   5
- *              5                    16                   4
- *              6                    21                   6
- *              7                    26                   2
- * --------------------------------------------------------
- * 
-*******************************************************************************/
-
-#include <pthread.h>    /* pthread functions and data structures for pipe */
-#include <unistd.h>     /* for POSIX API */
-#include <stdlib.h>     /* for exit() function */
-#include <stdio.h>      /* standard I/O routines */
-#include <stdbool.h>
-#include <string.h>
-#include <semaphore.h>
-#include <time.h>
-#include <fcntl.h>
-#include <errno.h>
-#include <sys/mman.h>
-#include <sys/types.h>
-#include <sys/shm.h>
-#include <sys/stat.h>
-
-/*---------------------------------- Constants -------------------------------*/
-
-#define NUM_OF_PROCESSES 7
-#define NAME_OF_FIFO "fifo"
-#define WRITE_INTERVAL 500*1000 // 500 milliseconds
-
-
-/*----------------------------------- Structs --------------------------------*/
-
-typedef struct SRTF_Params 
-{
-    int pid, arrive_t, wait_t, burst_t, turnaround_t, remain_t;
-} Process_Params;
-
-typedef struct Thread_Params
-{
-    sem_t readSem;
-    sem_t writeSem;
-    int readFIFO;
-    int writeFIFO;
-    char filename[64];
-    Process_Params processes[NUM_OF_PROCESSES+1];
-} Thread_Params;
-
-/*---------------------------------- Prototypes ------------------------------*/
-
-/* this function calculates CPU SRTF scheduling, writes waiting time and turn-around time to the FIFO */
-void *worker1(void *params);
-
-/* reads the waiting time and turn-around time through the FIFO and writes to text file */
-void *worker2(void *params);
-
-/* Outputs the welcome banner to the console */
-void outputWelcome();
-
-/* Outputs the header line to the console */
-void outputHeader();
-
-/* Outputs the dividing line to the console */
-void outputDivider();
-
-/* Outputs the footer line to the console */
-void outputFooter();
-
-/* Outputs a message line to the console */
-void outputLine(char *message, const char color);
-
-/* Outputs a message with variable line to the console */
-void outputVar(char *message, const char color, char *value);
-
-/* Changes the console color */
-void changeColor(const char color);
-
-/*---------------------------------- Functions -------------------------------*/
-
-/* this main function creates named pipe and threads */
-int main(int argc, char* argv[])
-{
-    /* creating a named pipe(FIFO) with read/write permission */
-    int makefifo = mkfifo(NAME_OF_FIFO, 0666);
-    if((makefifo == -1) && (errno != EEXIST))
-    {
-        perror("Error creating named pipe");
-        return(-11);
-    }
-
-    /* initialize the parameters */
-    int i;
-    pthread_t thread1, thread2;
-    Thread_Params params;
-    
-    // Get output file name from user
-    if(argc > 1)
-    {
-        strcpy(params.filename, argv[1]);
-    }
-    else
-    {
-        printf("Missing filename in command line arguments\n");
-        return(-12);
-    }
-    
-    // Set input data for CPU scheduling
-    params.processes[0].pid = 1; params.processes[0].arrive_t =  8; params.processes[0].burst_t = 10;
-    params.processes[1].pid = 2; params.processes[1].arrive_t = 10; params.processes[1].burst_t =  3;
-    params.processes[2].pid = 3; params.processes[2].arrive_t = 14; params.processes[2].burst_t =  7;
-    params.processes[3].pid = 4; params.processes[3].arrive_t =  9; params.processes[3].burst_t =  5;
-    params.processes[4].pid = 5; params.processes[4].arrive_t = 16; params.processes[4].burst_t =  4;
-    params.processes[5].pid = 6; params.processes[5].arrive_t = 21; params.processes[5].burst_t =  6;
-    params.processes[6].pid = 7; params.processes[6].arrive_t = 26; params.processes[6].burst_t =  2;
-    
-    //Initialise remaining time to be same as burst time
-    for(i = 0; i < NUM_OF_PROCESSES; i++) 
-    {
-        params.processes[i].remain_t = params.processes[i].burst_t;
-    }
-    
-    // Open FIFO for reading and writing
-    params.readFIFO  = open(NAME_OF_FIFO, O_RDONLY | O_NONBLOCK);
-    params.writeFIFO = open(NAME_OF_FIFO, O_WRONLY | O_NONBLOCK);
-    
-    // Output banner to the console
-    outputWelcome();
-    
-    /* initialise semaphore */
-    if(sem_init(&(params.readSem), 0, 0) != 0)
-    {
-        printf("Semaphore initialize error\n");
-        return(-10);
-    }
-    if(sem_init(&(params.writeSem), 0, 0) != 0)
-    {
-        printf("Semaphore initialize error\n");
-        return(-10);
-    }
-    
-    /* create threads */
-    if(pthread_create(&thread1, NULL, worker1, (void*)(&params)) != 0)
-    {
-        printf("Thread 1 created error\n");
-        return -1;
-    }
-    if(pthread_create(&thread2, NULL, worker2, (void*)(&params)) != 0)
-    {
-        printf("Thread 2 created error\n");
-        return -2;
-    }
-    
-    /* wait for threads to exit */
-    if(pthread_join(thread1, NULL) != 0)
-    {
-        printf("Join thread 1 error\n");
-        return -3;
-    }
-    if(pthread_join(thread2, NULL) != 0)
-    {
-        printf("Join thread 2 error\n");
-        return -4;
-    }
-    
-    /* destroy semaphore */
-    if(sem_destroy(&(params.readSem)) != 0)
-    {
-        printf("Semaphore destroy error\n");
-        return -5;
-    }
-    if(sem_destroy(&(params.writeSem)) != 0)
-    {
-        printf("Semaphore destroy error\n");
-        return -5;
-    }
-    
-    /* close the FIFO */
-    close(params.readFIFO);
-    close(params.writeFIFO);
-    
-    /* delete the FIFO */
-    if(unlink(NAME_OF_FIFO) < 0)
-    {
-        perror("Error deleting to FIFO");
-        return -6;
-    }
-    
-    return 0;
-}
-
-
-/* this function calculates CPU SRTF scheduling, writes waiting time and turn-around time to the FIFO */
-void *worker1(void *params)
-{
-    Thread_Params *worker1_params = (Thread_Params *)(params);
-    
-    float avg_wait_t       = 0.0;
-    float avg_turnaround_t = 0.0;
-    
-    int i, endTime, smallest, time, remain = 0;
-    
-    //Placeholder remaining time to be replaced
-    worker1_params->processes[NUM_OF_PROCESSES].remain_t = 9999;
-    
-    //Run function until remain is equal to number of processes
-    for(time = 0; remain != NUM_OF_PROCESSES; time++) 
-    {
-        //Assign placeholder remaining time as smallest
-        smallest = 7;
-        
-        //Check all processes that have arrived for lowest remain time then set the lowest to be smallest
-        for(i = 0; i < NUM_OF_PROCESSES; i++)
-        {
-            if(worker1_params->processes[i].arrive_t <= time 
-            && worker1_params->processes[i].remain_t < worker1_params->processes[smallest].remain_t 
-            && worker1_params->processes[i].remain_t > 0) 
-            {
-                smallest = i;
-            }
-        }
-        
-        //Decrease remaining time as time increases
-        worker1_params->processes[smallest].remain_t--;
-        
-        //If process is finished, save time information, add to average totals and increase remain
-        if(worker1_params->processes[smallest].remain_t == 0) 
-        {
-            remain++;
-            
-            endTime = time + 1;
-            
-            worker1_params->processes[smallest].turnaround_t = endTime - worker1_params->processes[smallest].arrive_t;
-            
-            worker1_params->processes[smallest].wait_t       = endTime - worker1_params->processes[smallest].burst_t - worker1_params->processes[smallest].arrive_t;
-            
-            avg_wait_t       += worker1_params->processes[smallest].wait_t;
-            
-            avg_turnaround_t += worker1_params->processes[smallest].turnaround_t;
-        }
-    }
-    
-    avg_wait_t       /= NUM_OF_PROCESSES;
-    avg_turnaround_t /= NUM_OF_PROCESSES;
-    
-    // Write average wait time to FIFO
-    if(write(worker1_params->writeFIFO, (float*)(&avg_wait_t), sizeof(avg_wait_t)) < 0)
-    {
-        perror("Error writing to FIFO");
-        exit(-1);
-    }
-    usleep(WRITE_INTERVAL);
-    sem_post(&(worker1_params->readSem));
-    
-    
-    sem_wait(&(worker1_params->writeSem));
-    
-    
-    // Write average turnaround time to FIFO
-    if(write(worker1_params->writeFIFO, (float*)(&avg_turnaround_t), sizeof(avg_turnaround_t)) < 0)
-    {
-        perror("Error writing to FIFO");
-        exit(-1);
-    }
-    usleep(WRITE_INTERVAL);
-    sem_post(&(worker1_params->readSem));
-    
-    pthread_exit(NULL);
-}
-
-/* reads the waiting time and turn-around time through the FIFO and writes to text file */
-void *worker2(void *params)
-{
-    Thread_Params *worker2_params = (Thread_Params *)(params);
-    
-    FILE* writeTxt;
-    
-    float avg_wait_t       = 0.0;
-    float avg_turnaround_t = 0.0;
-    
-    // Open file to output data
-    writeTxt = fopen(worker2_params->filename, "w");
-    if(writeTxt == NULL)
-    {
-        perror("Error opening file");
-        exit(-1);
-    }
-    
-    outputHeader();
-    outputLine("Calculated Times", 'Y');
-    outputFooter();
-    
-    sem_wait(&(worker2_params->readSem));
-    
-    // Read average wait time to FIFO
-    if(read(worker2_params->readFIFO, &avg_wait_t, sizeof(avg_wait_t)) < 0)
-    {
-        perror("Error reading from FIFO");
-        exit(-1);
-    }
-    printf("Average wait time: %fs\n", avg_wait_t);
-    sem_post(&(worker2_params->writeSem));
-    
-    sem_wait(&(worker2_params->readSem));
-    
-    // Read average turnaround time to FIFO
-    if(read(worker2_params->readFIFO, &avg_turnaround_t, sizeof(avg_turnaround_t)) < 0)
-    {
-        perror("Error reading from FIFO");
-        exit(-1);
-    }
-    printf("Average turnaround time: %fs\n", avg_turnaround_t);
-    
-    // Output CPU scheduling results table
-    outputHeader();
-    outputLine("Process Schedule Table", 'Y');
-    
-    printf("╠═════════╦═══════════════╦═══════════════╦═══════════════╦═══════════════════╣\n");
-    printf("║ ID      ║ Arrival Time  ║ Burst Time    ║ Wait Time     ║ Turnaround Time   ║\n");
-    printf("╠═════════╬═══════════════╬═══════════════╬═══════════════╬═══════════════════╣\n");
-    
-    int i;
-    
-    for(i = 0; i < NUM_OF_PROCESSES; i++) 
-    {
-        printf(
-            "║ %d\t  ║ %d\t\t  ║ %d\t\t  ║ %d\t\t  ║ %d\t\t      ║\n", 
-            (worker2_params->processes[i].pid),
-            (worker2_params->processes[i].arrive_t), 
-            (worker2_params->processes[i].burst_t), 
-            (worker2_params->processes[i].wait_t), 
-            (worker2_params->processes[i].turnaround_t)
-        );
-    }
-    
-    printf("╚═════════╩═══════════════╩═══════════════╩═══════════════╩═══════════════════╝\n");
-    
-    
-    // Write data to file then close it
-    fprintf(writeTxt, "%s %s %s %f", "Average", "wait", "time:", avg_wait_t);
-    fprintf(writeTxt, "%s %s %s %f", "\nAverage", "turnaround", "time:", avg_turnaround_t);
-    fclose(writeTxt);
-    
-    outputHeader();
-    outputLine("Program transferred data to file", 'Y');
-    outputFooter();
-    
-    pthread_exit(NULL);
-}
-
-/* Outputs the welcome banner to the console */
-void outputWelcome()
-{
-    printf("\x1B[33m");
-    printf("                                             _______________________\n");
-    printf("   _______________________-------------------                       `\\\n");
-    printf(" /:--__                                                              |\n");
-    printf("||< > |                                   ___________________________/\n");
-    printf("| \\__/_________________-------------------                         |\n");
-    printf("|                                                                  |\n");
-    printf(" |                                                                  |\n");
-    printf(" |                      THE SUPER CPU SCHEDULER                     |\n");
-    printf(" |                                                                  |\n");
-    printf("  |                         CPU Scheduling,                          |\n");
-    printf("  |                              FIFOs,                              |\n");
-    printf("  |                        Memory Managment,                         |\n");
-    printf("  |                           And Signals                             |\n");
-    printf("   |                                                                  |\n");
-    printf("   |                       By Jack Romanous                           |\n");
-    printf("   |                          (12551519)                             |\n");
-    printf("  |                                              ____________________|_\n");
-    printf("  |  ___________________-------------------------                      `\\\n");
-    printf("  |/`--_                                                                 |\n");
-    printf("  ||[ ]||                                            ___________________/\n");
-    printf("   \\===/___________________--------------------------\n\n");
-    printf("\x1B[0m");
-}
-
-/* Outputs the header line to the console */
-void outputHeader()
-{
-    printf("╔═════════════════════════════════════════════════════════════════════════════╗\n");
-}
-
-/* Outputs the dividing line to the console */
-void outputDivider()
-{
-    printf("╠═════════════════════════════════════════════════════════════════════════════╣\n");
-}
-
-/* Outputs the footer line to the console */
-void outputFooter()
-{
-    printf("╚═════════════════════════════════════════════════════════════════════════════╝\n");
-}
-
-/* Outputs a message line to the console */
-void outputLine(char *message, const char color)
-{
-    printf("║ ");
-    changeColor(color);
-    printf("%s", message);
-    
-    printf("\x1B[0m");
-    
-    for(int i = 0; i < (75 - strlen(message)); i++)
-    {
-        printf(" ");
-    }
-    printf(" ║\n");
-}
-
-/* Outputs a message with variable line to the console */
-void outputVar(char *message, const char color, char *value)
-{
-    int valLength = 0;
-    
-    printf("║ ");
-    changeColor(color);
-    printf("%s", message);
-    
-    for(int i = 0; i < strlen(value); i++)
-    {
-        if(value[i] != '\n' && value[i] != '\r' )
-        {
-            printf("%c", value[i]);
-            valLength++;
-        }
-    }
-    
-    printf("\x1B[0m");
-    
-    for(int i = 0; i < (75 - strlen(message) - valLength); i++)
-    {
-        printf(" ");
-    }
-    printf(" ║\n");
-}
-
-/* Changes the console color */
-void changeColor(const char color)
-{
-    switch(color)
-    {
-        case 'R':
-            printf("\x1B[31m");
-            break;
-        case 'G':
-            printf("\x1B[32m");
-            break;
-        case 'Y':
-            printf("\x1B[33m");
-            break;
-        case 'B':
-            printf("\x1B[34m");
-            break;
-        case 'M':
-            printf("\x1b[35m");
-            break;
-        case 'C':
-            printf("\x1b[36m");
-            break;
-    }
+/*******************************************************************************
+ * 
+ * Project: SRTF CPU Scheduling
+ * 
+ * Authors:
+ * Jack Romanous
+ * 
+ * Compile instructions:
+ * Ensure that gcc is installed and run the following command:
+ * gcc -Wall -O2 SRTF-CPU-scheduling.c -o SRTF-CPU-scheduling -lpthread -lrt
+ * 
+ * Usage:
+ * ./SRTF-CPU-scheduling [-t trace] [-u tick] [-p policy,...] [-q quantum] [-c cores]
+ *                       [-m cost] [-b none|steal|rebalance[:interval]]
+ *                       [-l events.bin] [-j events.json] [-L events] [-r usec]
+ *                       [-H histograms.bin] output.txt
+ * ./SRTF-CPU-scheduling -S sweep.csv [-w workers] [-t trace]... [-u tick] [-p policy,...]
+ *                       [-q quantum,...] [-c cores,...] [-m cost,...] [-b balance,...]
+ *                       [-H histograms.bin]
+ * ./SRTF-CPU-scheduling -i input [-u tick] [-p policy] [-q quantum] [-c cores]
+ *                       [-m cost] [-b balance] [-H histograms.bin] output.csv
+ * ./SRTF-CPU-scheduling -M merged.bin histograms.bin...
+ * ./SRTF-CPU-scheduling -B
+ * 
+ * Notes:
+ * Without -t the input data of the cpu scheduling algorithm is:
+ * --------------------------------------------------------
+ *     Process ID           Arrive time          Burst time
+ *              1                     8                  10
+ *              2                    10                   3
+ *              3                    14                   7
+ *              4                     9                   5
+ *              5                    16                   4
+ *              6                    21                   6
+ *              7                    26                   2
+ * --------------------------------------------------------
+ * 
+ * -t loads the processes from a trace file instead. A text trace has one
+ * "pid,arrive,burst" line per process, separated by commas or spaces, with
+ * an optional header line and # comments. Two more columns may follow, the
+ * priority (0 is the highest) and the deadline (-1 for none). A binary trace
+ * starts with the 8 bytes of TRACE_MAGIC and a 64-bit count, followed by one
+ * Trace_Record of three 32-bit ints per process.
+ * 
+ * -u sets how many trace time units make one tick of the scheduler
+ * (default 1), which may be a fraction. Text traces may then give their
+ * times as decimals or as 64-bit counts, such as nanoseconds. A trace's
+ * arrive times are rounded down to a tick and its burst times and
+ * deadlines up, so no burst rounds away. Every time the scheduler shows,
+ * and -q, -m and the rebalance interval, is in ticks. The clock jumps
+ * from event to event, so a sparse trace costs the same whatever its
+ * span, which only has to fit INT_MAX ticks.
+ * 
+ * -p picks the scheduling policies, run one after the other over the same
+ * processes and compared side by side (default srtf):
+ *     srtf      shortest remaining time first, preemptive
+ *     fcfs      first come first served
+ *     sjf       shortest job first, non-preemptive
+ *     rr        round-robin with a time slice of -q (default DEFAULT_QUANTUM)
+ *     priority  lowest priority first, non-preemptive, a waiting process
+ *               gains one level every AGING_INTERVAL
+ *     mlfq      MLFQ_LEVELS round-robin queues, the slice doubling at each
+ *               level, a process drops a level when it uses up its slice
+ *     edf       earliest deadline first, preemptive, a process without a
+ *               deadline is due when its burst would end if it ran at once
+ *     all       every policy above
+ * 
+ * The scheduler is event-driven. Arrived processes wait in a min-heap
+ * ordered by a key the policy gives them, and the rest wait in a queue
+ * sorted by arrival time. The clock jumps from one arrival, completion or
+ * end of slice to the next, so a run costs O((N + preemptions) log N)
+ * however long the trace spans. Ties go to the process listed first, as the
+ * original tick-by-tick scan did. The table shows the first policy's times.
+ * 
+ * -c simulates several CPUs, each with its own run queue. Processes are
+ * queued on the cores in turn as they arrive, and the policy runs on each
+ * core by itself. -b picks how the load is evened out (default steal):
+ *     none       processes stay on the core they were queued on
+ *     steal      an idle core takes the first waiting process of the core
+ *                with the most waiting
+ *     rebalance  every interval (default REBALANCE_INTERVAL) processes move
+ *                from the busiest queues to the quietest until they differ
+ *                by at most one
+ * Every move costs the -m migration time (default 0), which is run on the
+ * new core before the process itself and counts towards its wait time.
+ * The cores keep their next stop in a tournament tree and charge the time
+ * a process ran only when it stops, so an event costs O(log N + log C).
+ * 
+ * worker1 streams a Completion_Record through the FIFO for each process as
+ * it finishes, in blocks of RECORDS_PER_WRITE, and closes its end when the
+ * last policy is done. worker2 reads them as they come until the end of
+ * the FIFO, working out the averages and the table from them.
+ * 
+ * Each run counts its wait, turnaround and response times (from arriving
+ * to first getting a CPU) in a Latency_Histogram, whose percentiles are
+ * shown for every policy. Values below HIST_SUB_COUNT have a bucket each
+ * and every power of two above them is split into HIST_SUB_COUNT / 2
+ * buckets, so a percentile is at most 1/64 above the true value and a
+ * histogram takes the same HIST_BUCKETS counts for any number of
+ * processes. Histograms are merged by adding their counts. -H writes them
+ * as HIST_MAGIC, the sub-bucket bits and the number of histograms, then
+ * each histogram's name, count, total, min and max, and only the buckets
+ * it uses. A sweep writes each policy's histograms merged over all its
+ * runs, and -M merges the histograms of the same name from several files.
+ * 
+ * The scheduler only looks at the processes its heaps point it to, so the
+ * process table stays an array of structs. A scan of every process for
+ * the least remaining time among those that have arrived reads only two
+ * of their fields, which Process_Columns keeps in arrays of their own.
+ * scanMinAVX2 and scanMinAVX512 read those eight or sixteen processes at
+ * a time. -B times the scans over the columns against the one over the
+ * table, for SCAN_MIN_PROCESSES up to SCAN_MAX_PROCESSES processes,
+ * skipping the kernels the CPU cannot run.
+ * 
+ * -l and -j log every dispatch, preemption, end of slice, migration and
+ * completion as a Sim_Event. The events go into an arena of -L events
+ * (default EVENT_ARENA_SIZE) allocated before the run, and those past its
+ * end are only counted. -l writes the log as EVENT_MAGIC, a 64-bit count
+ * and the events. -j exports it as Chrome trace-event JSON, which
+ * chrome://tracing and Perfetto open: each policy is a process, each core
+ * a thread and each stretch a process ran a slice, at 1us per time unit.
+ * 
+ * -r also runs every policy for real once the simulation is done, each
+ * process being a thread that works -r microseconds of its own CPU time
+ * per time unit. A dispatcher gives one thread the CPU at a time, in the
+ * order of the policy's keys. The threads yield after each unit, stopping
+ * there once their slice is used up or the dispatcher has told them to
+ * because a process arrived that the policy lets preempt them. The
+ * measured wait and turnaround times are compared with the simulated
+ * ones, along with the dispatch latency, the time from a thread being
+ * given the CPU to it running. This needs one core and at most
+ * REAL_MAX_PROCESSES processes.
+ * 
+ * -S sweeps a grid instead of running the FIFO threads: -t may be given
+ * several times and -q, -c, -m and -b take comma separated lists. Every
+ * combination is a job for a pool of -w workers (default one per CPU).
+ * The traces are loaded once and shared, and each worker runs its jobs on
+ * its own copy of the process table, so the workers only meet to take the
+ * next job and to write their row of the CSV. A quantum is only swept for
+ * policies with a slice, and a migration cost or balancing only with more
+ * than one core.
+ * 
+ * -i schedules a live stream of arrivals instead of a trace, for one
+ * policy. The input is a named pipe, made if it does not exist, or - for
+ * stdin, and carries the lines of a text trace in arrival order as they
+ * happen. Each finished process is written to the output (- for stdout,
+ * the console then going to stderr) as a "pid,arrive,burst,wait,
+ * turnaround,completion" line, flushed after every read of the input, so
+ * a replay test can check the decisions as they are made. The clock only
+ * moves past a time once an arrival for a later one is read, or the input
+ * ends. A process that arrives before the time the scheduler has reached
+ * arrives then instead, and is counted as late. Finished processes give
+ * back their slot of the process table, which only grows to the most
+ * processes live at once, and ties go to the process that arrived first,
+ * whatever its slot. The time the scheduler takes over each arrival is
+ * counted in nanoseconds in a histogram of its own.
+ * 
+*******************************************************************************/
+
+#include <pthread.h>    /* pthread functions and data structures for pipe */
+#include <unistd.h>     /* for POSIX API */
+#include <stdlib.h>     /* for exit() function */
+#include <stdio.h>      /* standard I/O routines */
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <limits.h>
+#include <getopt.h>
+#ifdef __x86_64__
+#include <immintrin.h>  /* AVX2 and AVX-512 scan kernels */
+#endif
+
+/*---------------------------------- Constants -------------------------------*/
+
+#define NUM_OF_DEFAULT_PROCESSES 7
+#define NAME_OF_FIFO "fifo"
+#define RECORDS_PER_WRITE 170   // completion records in one write, 4080 bytes fit an atomic pipe write
+#define TABLE_ROWS 20           // processes shown in the console table
+#define TRACE_MAGIC "SRTFTRC1"  // first bytes of a binary trace
+#define TRACE_LINE_SIZE 256
+#define MAX_POLICIES 16         // policies compared in one run
+#define DEFAULT_QUANTUM 4       // time slice of rr and the top mlfq queue
+#define MLFQ_LEVELS 3           // mlfq queues, each with twice the slice of the one above
+#define AGING_INTERVAL 10       // waiting time that raises a priority by one
+#define MAX_CORES 1024
+#define REBALANCE_INTERVAL 100  // time between rebalances of the run queues
+#define BALANCE_NONE 0
+#define BALANCE_STEAL 1
+#define BALANCE_REBALANCE 2
+#define MAX_GRID_VALUES 64      // values of one setting in a sweep
+#define MAX_WORKERS 256
+#define SWEEP_ROW_SIZE 512
+#define HIST_SUB_BITS 7
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (HIST_SUB_COUNT + (31 - HIST_SUB_BITS) * (HIST_SUB_COUNT / 2))
+#define HIST_MAGIC "SRTFHST1"   // first bytes of a histogram file
+#define HIST_NAME_SIZE 32
+#define MAX_HISTOGRAMS 256      // histograms a merge can hold
+#define SCAN_MIN_PROCESSES 1000
+#define SCAN_MAX_PROCESSES 10000000
+#define SCAN_WORK (1L << 27)    // processes each benchmark scans in all
+#define REAL_MAX_PROCESSES 4096
+#define REAL_STACK_SIZE (64 * 1024)
+#define REAL_SPIN 256           // work done between looks at the CPU clock
+#define EVENT_MAGIC "SRTFEVT1"  // first bytes of a binary event log
+#define EVENT_ARENA_SIZE (4L << 20) // events logged by default, 12 bytes each
+#define EVENT_DISPATCH 0
+#define EVENT_PREEMPT 1
+#define EVENT_SLICE_END 2
+#define EVENT_COMPLETE 3
+#define EVENT_MIGRATE 4
+#define STREAM_BUFFER_SIZE (64 * 1024) // bytes of arrivals read at once
+#define STREAM_START_SLOTS 1024 // process slots of a stream before it grows them
+
+
+/*----------------------------------- Structs --------------------------------*/
+
+typedef struct SRTF_Params 
+{
+    int pid, arrive_t, wait_t, burst_t, turnaround_t, remain_t, priority, deadline_t, response_t;
+} Process_Params;
+
+/* the fields a full scan of the processes reads, each in its own array */
+typedef struct Process_Columns
+{
+    int32_t *arrive_t;
+    int32_t *remain_t;
+    int count;
+} Process_Columns;
+
+/* a scan of the columns for the arrived, unfinished process with the least remaining time */
+typedef int (*Scan_Kernel)(const Process_Columns *columns, int time);
+
+/* one finished process, as sent through the FIFO */
+typedef struct Completion_Record
+{
+    int32_t policy, index, pid, wait_t, turnaround_t, completion_t;
+} Completion_Record;
+
+/* completion records waiting to be written to the FIFO */
+typedef struct Record_Writer
+{
+    int fd;
+    int policy;             // policy of the records being added
+    int count;
+    Completion_Record records[RECORDS_PER_WRITE];
+} Record_Writer;
+
+/* one scheduling event of the log */
+typedef struct Sim_Event
+{
+    int32_t time;
+    int32_t pid;
+    uint16_t core;          // core the process left or was given, or was moved to
+    uint8_t type;
+    uint8_t policy;
+} Sim_Event;
+
+/* events of the runs, kept in an arena allocated before them */
+typedef struct Event_Log
+{
+    Sim_Event *events;
+    long count;
+    long capacity;
+    long dropped;           // events that did not fit
+    int policy;             // policy of the events being added
+} Event_Log;
+
+/* one process of a binary trace */
+typedef struct Trace_Record
+{
+    int32_t pid, arrive_t, burst_t;
+} Trace_Record;
+
+/* one process in the ready heap, smaller keys run first and ties go to the one that arrived first */
+typedef struct Heap_Entry
+{
+    uint64_t key;
+    int index;
+    uint32_t order;         // arrival order, which breaks ties between equal keys
+} Heap_Entry;
+
+/* the settings of one simulation run */
+typedef struct Sim_Config
+{
+    int quantum;
+    int numCores;
+    int migrationCost;
+    int balance;
+    int interval;           // time between rebalances
+} Sim_Config;
+
+/* the values given for each setting, a sweep runs every combination */
+typedef struct Sim_Grid
+{
+    const char *traces[MAX_GRID_VALUES];
+    int quanta[MAX_GRID_VALUES];
+    int cores[MAX_GRID_VALUES];
+    int costs[MAX_GRID_VALUES];
+    int balances[MAX_GRID_VALUES];
+    int intervals[MAX_GRID_VALUES];
+    int numTraces, numQuanta, numCores, numCosts, numBalances;
+} Sim_Grid;
+
+/* one simulated CPU */
+typedef struct Core_State
+{
+    Heap_Entry *heap;       // run queue
+    int heapSize, heapCapacity;
+    int running;            // process on the core, -1 when idle
+    int expired;            // process that last used up its slice here
+    int requeue;            // process to queue again once this time's arrivals are in
+    int since;              // time the running process was last charged to
+    int dispatched;         // time the running process got the core
+    long long sliceEnd;
+    long long stop;         // time the running process finishes or ends its slice
+    long long busy_t;       // time spent running processes, migrations included
+    long completed;
+    long migrations;        // processes moved here from other cores
+    bool pending;           // listed to be given a process at this time
+} Core_State;
+
+/* state of a simulation run that the policies key the ready heap on */
+typedef struct Sim_State
+{
+    Process_Params *processes;
+    const struct Sched_Policy *policy;
+    int time;
+    int quantum;
+    uint64_t sequence;      // processes queued so far
+    unsigned char *level;   // mlfq queue of each process
+    Core_State *cores;
+    int numCores;
+    int *tree;              // tournament tree of the core that stops first
+    int leaves;
+    int *pending;           // cores to be given a process at this time
+    int numPending;
+    int migrationCost;
+    long queued;            // processes waiting in all the run queues
+    int idle;               // cores without a process
+    long preemptions;
+    Event_Log *log;         // NULL when events are not logged
+    uint32_t *order;        // arrival order of each process, NULL when it is the index
+} Sim_State;
+
+/* a scheduling policy, runPolicy() does the rest */
+typedef struct Sched_Policy
+{
+    const char *name;
+    /* key of a process joining the ready heap */
+    uint64_t (*key)(Sim_State *sim, int index);
+    /* whether an arriving process takes the CPU from the running one, NULL if it never does */
+    bool (*preempts)(Sim_State *sim, int arrival, int running);
+    /* time a process may run before it is queued again, NULL for no limit */
+    int (*slice)(Sim_State *sim, int index);
+    /* called when a process uses up its slice, NULL if nothing changes */
+    void (*expired)(Sim_State *sim, int index);
+} Sched_Policy;
+
+/* counts of non-negative times in buckets that widen as the times grow */
+typedef struct Latency_Histogram
+{
+    uint64_t count;
+    uint64_t total;
+    int32_t min, max;
+    uint64_t buckets[HIST_BUCKETS];
+} Latency_Histogram;
+
+/* a histogram with its name, as read from a file */
+typedef struct Named_Histogram
+{
+    char name[HIST_NAME_SIZE];
+    Latency_Histogram hist;
+} Named_Histogram;
+
+/* what one policy made of the trace */
+typedef struct Policy_Result
+{
+    const Sched_Policy *policy;
+    float avg_wait_t, avg_turnaround_t;
+    int max_wait_t, p99_wait_t;
+    Latency_Histogram wait, turnaround, response;
+    int makespan;           // time the last process finished
+    long preemptions;
+    long migrations;
+    Core_State *cores;      // what each core did, without its run queue
+    double simTime;
+} Policy_Result;
+
+typedef struct Thread_Params
+{
+    int readFIFO;
+    int writeFIFO;
+    char filename[64];
+    Process_Params *processes;
+    int numProcesses;
+    int capacity;
+    double tick;            // trace time units in one tick
+    Sim_Config config;
+    Policy_Result results[MAX_POLICIES];
+    int numPolicies;
+    Event_Log log;
+} Thread_Params;
+
+/* a trace loaded for a sweep, which the workers only read */
+typedef struct Sweep_Trace
+{
+    const char *name;
+    Process_Params *processes;
+    int numProcesses;
+    uint64_t *arrivals;
+} Sweep_Trace;
+
+/* what the sweep workers share */
+typedef struct Sweep_Params
+{
+    Sim_Grid *grid;
+    Sweep_Trace traces[MAX_GRID_VALUES];
+    int numTraces;
+    const struct Sched_Policy *policies[MAX_POLICIES];
+    int numPolicies;
+    long numJobs;
+    long nextJob;
+    long runs;
+    pthread_mutex_t lock;   // guards the jobs, the runs, the CSV and the pooled histograms
+    FILE *csv;
+    Policy_Result *pooled;  // each policy's histograms over all its runs, NULL without -H
+} Sweep_Params;
+
+/* one process run as a real thread */
+typedef struct Real_Thread
+{
+    pthread_t tid;
+    pthread_cond_t go;          // signalled when the dispatcher gives it the CPU
+    struct Real_State *state;
+    int index;
+    int slice;                  // units left in its slice, 0 for no limit
+    bool running;
+    bool stop;                  // set to preempt it at its next yield point
+    bool expired;               // it stopped because its slice was used up
+    long long resumed;          // ns the dispatcher last gave it the CPU
+    long long stopped;          // ns it last stopped
+} Real_Thread;
+
+/* a real run, shared by its dispatcher and the process threads */
+typedef struct Real_State
+{
+    pthread_mutex_t lock;
+    pthread_cond_t yielded;     // signalled when the running thread stops
+    Sim_State sim;              // policy state, its time in whole units
+    Real_Thread *threads;
+    long long start;            // ns the run started
+    long long unit;             // ns of CPU time per time unit
+    int stopped;                // thread that stopped and was not yet taken back, or -1
+    long long totalLatency;
+    long long maxLatency;
+    long dispatches;
+} Real_State;
+
+/* how a policy did when its processes were really run */
+typedef struct Real_Result
+{
+    double avg_wait_t;
+    double avg_turnaround_t;
+    double avg_latency;         // us from being given the CPU to running
+    double max_latency;
+    long preemptions;
+} Real_Result;
+
+/* a run over a live stream of arrivals, whose process slots are reused once their processes finish */
+typedef struct Stream_State
+{
+    Sim_State sim;
+    const Sim_Config *config;
+    Policy_Result *result;
+    const char *input;
+    double tick;
+    FILE *output;
+    Completion_Record *finished;    // processes finished since the output was last written
+    int numFinished;
+    int finishedCapacity;
+    int *freeSlots;
+    int numFree;
+    int capacity;           // process slots, which only grow
+    int live;               // processes arrived and not yet finished
+    int peak;
+    long long work;         // burst time of the live processes, which has to fit the clock
+    long long arrivals;
+    long long done;
+    long long late;         // arrivals before the time the scheduler had reached
+    double total_wait_t, total_turnaround_t;
+    bool started;           // the clock has reached a time, whose arrivals are still coming in
+    Latency_Histogram decision; // ns the scheduler took over each arrival
+} Stream_State;
+
+/*----------------------------------- Data -----------------------------------*/
+
+/* pid, arrive time and burst time of the processes used without a trace */
+static const int defaultProcesses[NUM_OF_DEFAULT_PROCESSES][3] =
+{
+    {1,  8, 10},
+    {2, 10,  3},
+    {3, 14,  7},
+    {4,  9,  5},
+    {5, 16,  4},
+    {6, 21,  6},
+    {7, 26,  2}
+};
+
+/*---------------------------------- Prototypes ------------------------------*/
+
+/* this function runs the scheduling policies, streams the processes to the FIFO as they finish */
+void *worker1(void *params);
+
+/* reads the finished processes through the FIFO and writes their average times to text file */
+void *worker2(void *params);
+
+/* adds a finished process to the writer, writing a full block to the FIFO */
+void recordWrite(Record_Writer *writer, int index, int pid, int wait_t, int turnaround_t, int completion_t);
+
+/* writes the records waiting in the writer to the FIFO */
+void recordFlush(Record_Writer *writer);
+
+/* adds a process to the table, growing it as needed */
+void addProcess(Thread_Params *params, int pid, int arrive_t, int burst_t, int priority, int deadline_t);
+
+/* fills in a process after checking its times */
+void setProcess(Process_Params *process, int pid, int arrive_t, int burst_t, int priority, int deadline_t);
+
+/* adds the policies of a comma separated list to the run */
+void parsePolicies(Thread_Params *params, const char *list);
+
+/* reads a comma separated list of whole numbers into values, returns how many */
+int parseValues(const char *list, int *values, int minimum, int maximum, const char *name);
+
+/* reads a comma separated list of load balancing into the grid */
+void parseBalances(Sim_Grid *grid, const char *list);
+
+/* loads the processes of a trace, or the default table without one, and checks them */
+void loadProcesses(Thread_Params *params, const char *filename);
+
+/* loads the processes of a text or binary trace file */
+void loadTrace(Thread_Params *params, const char *filename);
+
+/* loads the records of a binary trace after its magic */
+void loadBinaryTrace(Thread_Params *params, FILE *trace, const char *filename);
+
+/* loads the "pid,arrive,burst[,priority[,deadline]]" lines of a text trace */
+void loadTextTrace(Thread_Params *params, FILE *trace, const char *filename);
+
+/* reads a "pid,arrive,burst[,priority[,deadline]]" line into fields, returns 1 for a process, 0 for a
+ * line to skip and -1 for one that cannot be read, a header line only being skipped before the first process */
+int parseTraceLine(char *line, double *fields, bool first);
+
+/* converts a trace time to ticks, rounding a length of time up and a point in time down */
+int traceTicks(double value, double tick, bool roundUp, const char *filename);
+
+/* returns the processes as arrive time and index keys sorted by arrival */
+uint64_t *sortArrivals(Process_Params *processes, int count);
+
+/* reads one load balancing of -b */
+void parseBalance(const char *text, int *balance, int *interval);
+
+/* runs one policy over the processes, leaving its wait and turnaround times in the table */
+void runPolicy(Process_Params *processes, int count, const uint64_t *arrivals, const Sim_Config *config,
+    Policy_Result *result, Record_Writer *writer, Event_Log *log);
+
+/* sets up a run with every core idle, for up to count processes */
+void simStart(Sim_State *sim, Process_Params *processes, int count, const Sim_Config *config,
+    const Sched_Policy *policy, Event_Log *log);
+
+/* returns the next time a core stops, the next process arrives or, with processes waiting,
+ * the run queues are rebalanced */
+long long simNextTime(Sim_State *sim, const Sim_Config *config, long long arrival);
+
+/* takes the process off each core that finishes it or ends its slice now, returning the
+ * next one that is finished, or -1 once there are none */
+int simStop(Sim_State *sim);
+
+/* works out the wait and turnaround times of a finished process and counts them */
+void simCompleted(Sim_State *sim, Policy_Result *result, int index);
+
+/* queues an arriving process on a core, unless the policy gives it that core's CPU */
+void simArrive(Sim_State *sim, int index, int target);
+
+/* queues the processes that used up their slice, gives the idle cores work and evens out the queues */
+void simSettle(Sim_State *sim, const Sim_Config *config);
+
+/* drops the run queues, keeping what each core did in the result */
+void simFinish(Sim_State *sim, Policy_Result *result);
+
+/* returns the arrival order of a process */
+uint32_t simOrder(Sim_State *sim, int index);
+
+/* schedules the processes of a live stream as they arrive, writing each one out as it finishes */
+int runStream(Thread_Params *params, const char *input, const char *histFilename);
+
+/* adds a process of the stream, moving the clock on to its arrival first */
+void streamArrive(Stream_State *stream, const double *fields);
+
+/* runs the stream up to the given time, where the clock stays for the arrivals still to come */
+void streamAdvance(Stream_State *stream, long long time);
+
+/* takes each process that finishes now for the output and gives back its slot */
+void streamStop(Stream_State *stream);
+
+/* writes the finished processes to the output */
+void streamWrite(Stream_State *stream);
+
+/* returns a free process slot, doubling the slots when every one is live */
+int streamSlot(Stream_State *stream);
+
+/* adds an event to the log, only counting it once the arena is full */
+void logEvent(Sim_State *sim, int type, int core, int index);
+
+/* writes the event log as a binary file */
+void writeEventLog(Event_Log *log, const char *filename);
+
+/* exports the event log as Chrome trace-event JSON */
+void writeChromeTrace(Thread_Params *params, const char *filename);
+
+/* runs every policy again with a thread for each process, comparing it with the simulation */
+void realCompare(Thread_Params *params, long unit);
+
+/* runs one policy with a thread for each process, a time unit being unit ns of CPU work */
+void runReal(Process_Params *processes, int count, const uint64_t *arrivals, const Sched_Policy *policy,
+    int quantum, long long unit, Real_Result *result);
+
+/* this thread is one process, working a unit at a time while the dispatcher lets it */
+void *realWorker(void *thread);
+
+/* uses up a time unit of the calling thread's CPU time */
+void realWork(long long unit);
+
+/* returns the time of a clock in ns */
+long long clockNs(clockid_t clock);
+
+/* runs every combination of the grid on a pool of workers, writing a CSV row for each */
+int runSweep(Sim_Grid *grid, Thread_Params *params, const char *filename, int workers, const char *histFilename);
+
+/* this thread runs sweep jobs until there are none left */
+void *sweepWorker(void *params);
+
+/* queues a process on a core, which is given it at the end of this time if idle */
+void coreQueue(Sim_State *sim, int core, int index);
+
+/* gives an idle core the first process of its queue */
+void coreDispatch(Sim_State *sim, int core);
+
+/* charges the time the running process has had since it was last charged */
+void coreCharge(Sim_State *sim, int core);
+
+/* works out when the core next stops and moves it in the tournament tree */
+void coreUpdate(Sim_State *sim, int core);
+
+/* gives every listed core that is idle the first process of its queue */
+void dispatchPending(Sim_State *sim);
+
+/* moves the first waiting process of one core to another */
+void migrate(Sim_State *sim, int from, int to);
+
+/* lets every idle core take a process from the core with the most waiting */
+void stealWork(Sim_State *sim);
+
+/* moves processes from the busiest to the quietest cores until they differ by at most one */
+void rebalance(Sim_State *sim);
+
+/* empties a histogram */
+void histReset(Latency_Histogram *hist);
+
+/* counts a time in its bucket */
+void histRecord(Latency_Histogram *hist, int value);
+
+/* adds the counts of one histogram to another */
+void histMerge(Latency_Histogram *hist, const Latency_Histogram *other);
+
+/* returns the bucket a time is counted in */
+int histBucket(int value);
+
+/* returns the highest time counted in a bucket */
+int histHighest(int bucket);
+
+/* returns the time at or below which a fraction of the counted times are */
+int histPercentile(const Latency_Histogram *hist, double fraction);
+
+/* writes the wait, turnaround and response histograms of each policy to a file */
+void histExport(Policy_Result *results, int count, const char *filename);
+
+/* writes the start of a histogram file */
+void histWriteHeader(FILE *file, uint32_t count);
+
+/* writes a histogram with only the buckets it uses */
+void histWrite(FILE *file, const char *name, const Latency_Histogram *hist);
+
+/* reads the next histogram of a file, returns false at its end */
+bool histRead(FILE *file, const char *filename, Named_Histogram *named);
+
+/* merges the histograms of the same name from several files into one file */
+int runMerge(const char *filename, char **inputs, int numInputs);
+
+/* adds a process with its key to the ready heap */
+void heapPush(Heap_Entry *heap, int *size, uint64_t key, int index, uint32_t order);
+
+/* copies the fields a scan reads into columns */
+void columnsLoad(Process_Columns *columns, const Process_Params *processes, int count);
+
+/* frees the columns */
+void columnsFree(Process_Columns *columns);
+
+/* scans for the arrived, unfinished process with the least remaining time, the first listed
+ * on a tie, returning -1 if there is none; over the table, over the columns, and with AVX2 and AVX-512 */
+int scanMinTable(const Process_Params *processes, int count, int time);
+int scanMinColumns(const Process_Columns *columns, int time);
+#ifdef __x86_64__
+int scanMinAVX2(const Process_Columns *columns, int time);
+int scanMinAVX512(const Process_Columns *columns, int time);
+#endif
+
+/* times the scans over growing numbers of processes */
+int runBenchmark();
+
+/* removes the process with the smallest key from the ready heap */
+int heapPop(Heap_Entry *heap, int *size);
+
+/* policy keys: remaining time, arrive time, burst time, queue order, aged priority,
+ * mlfq level then queue order, and deadline */
+uint64_t srtfKey(Sim_State *sim, int index);
+uint64_t fcfsKey(Sim_State *sim, int index);
+uint64_t sjfKey(Sim_State *sim, int index);
+uint64_t rrKey(Sim_State *sim, int index);
+uint64_t priorityKey(Sim_State *sim, int index);
+uint64_t mlfqKey(Sim_State *sim, int index);
+uint64_t edfKey(Sim_State *sim, int index);
+
+/* an arrival preempts with less remaining time, a higher mlfq queue or an earlier deadline */
+bool srtfPreempts(Sim_State *sim, int arrival, int running);
+bool mlfqPreempts(Sim_State *sim, int arrival, int running);
+bool edfPreempts(Sim_State *sim, int arrival, int running);
+
+/* time slices of rr and of each mlfq queue */
+int rrSlice(Sim_State *sim, int index);
+int mlfqSlice(Sim_State *sim, int index);
+
+/* moves a process that used up its slice down an mlfq queue */
+void mlfqExpired(Sim_State *sim, int index);
+
+/* Outputs the welcome banner to the console */
+void outputWelcome();
+
+/* Outputs the header line to the console */
+void outputHeader();
+
+/* Outputs the dividing line to the console */
+void outputDivider();
+
+/* Outputs the footer line to the console */
+void outputFooter();
+
+/* Outputs the percentile table header to the console */
+void outputPercentileHeader();
+
+/* Outputs the percentiles of a histogram as a table row to the console */
+void outputPercentiles(const char *name, const Latency_Histogram *hist);
+
+/* Outputs the percentile table footer to the console */
+void outputPercentileFooter();
+
+/* Outputs a message line to the console */
+void outputLine(char *message, const char color);
+
+/* Outputs a message with variable line to the console */
+void outputVar(char *message, const char color, char *value);
+
+/* Changes the console color */
+void changeColor(const char color);
+
+/*---------------------------------- Policies --------------------------------*/
+
+static const Sched_Policy policies[] =
+{
+    {"srtf",     srtfKey,     srtfPreempts, NULL,      NULL},
+    {"fcfs",     fcfsKey,     NULL,         NULL,      NULL},
+    {"sjf",      sjfKey,      NULL,         NULL,      NULL},
+    {"rr",       rrKey,       NULL,         rrSlice,   NULL},
+    {"priority", priorityKey, NULL,         NULL,      NULL},
+    {"mlfq",     mlfqKey,     mlfqPreempts, mlfqSlice, mlfqExpired},
+    {"edf",      edfKey,      edfPreempts,  NULL,      NULL}
+};
+
+#define NUM_OF_POLICIES (int)(sizeof(policies) / sizeof(policies[0]))
+
+/*---------------------------------- Functions -------------------------------*/
+
+/* this main function creates named pipe and threads */
+int main(int argc, char* argv[])
+{
+    /* initialize the parameters */
+    int i, option, makefifo;
+    int workers = sysconf(_SC_NPROCESSORS_ONLN);
+    long realUnit = 0;
+    const char *sweepFilename = NULL, *logFilename = NULL, *jsonFilename = NULL;
+    const char *histFilename = NULL, *mergeFilename = NULL, *streamFilename = NULL;
+    char value[64];
+    pthread_t thread1, thread2;
+    Thread_Params params;
+    Sim_Grid grid;
+    
+    params.processes = NULL;
+    params.numProcesses = 0;
+    params.capacity = 0;
+    params.numPolicies = 0;
+    params.tick = 1.0;
+    params.log.events = NULL;
+    params.log.count = 0;
+    params.log.capacity = EVENT_ARENA_SIZE;
+    params.log.dropped = 0;
+    memset(&grid, 0, sizeof(grid));
+    
+    // Read options from the command line
+    while((option = getopt(argc, argv, "t:u:p:q:c:m:b:S:w:l:j:L:r:H:M:i:Bh")) != -1)
+    {
+        switch(option)
+        {
+            case 't':
+                if(grid.numTraces == MAX_GRID_VALUES)
+                {
+                    printf("At most %d traces can be given\n", MAX_GRID_VALUES);
+                    return(-12);
+                }
+                grid.traces[grid.numTraces++] = optarg;
+                break;
+            case 'u':
+                params.tick = strtod(optarg, NULL);
+                if(!(params.tick > 0.0) || params.tick > 1e18)
+                {
+                    printf("Tick must be above 0 trace units\n");
+                    return(-12);
+                }
+                break;
+            case 'p':
+                parsePolicies(&params, optarg);
+                break;
+            case 'q':
+                grid.numQuanta = parseValues(optarg, grid.quanta, 1, INT_MAX >> (MLFQ_LEVELS - 1), "Quantum");
+                break;
+            case 'c':
+                grid.numCores = parseValues(optarg, grid.cores, 1, MAX_CORES, "Cores");
+                break;
+            case 'm':
+                grid.numCosts = parseValues(optarg, grid.costs, 0, INT_MAX, "Migration cost");
+                break;
+            case 'b':
+                parseBalances(&grid, optarg);
+                break;
+            case 'S':
+                sweepFilename = optarg;
+                break;
+            case 'w':
+                workers = atoi(optarg);
+                if(workers <= 0 || workers > MAX_WORKERS)
+                {
+                    printf("Workers must be between 1 and %d\n", MAX_WORKERS);
+                    return(-12);
+                }
+                break;
+            case 'l':
+                logFilename = optarg;
+                break;
+            case 'j':
+                jsonFilename = optarg;
+                break;
+            case 'L':
+                params.log.capacity = atol(optarg);
+                if(params.log.capacity <= 0)
+                {
+                    printf("Event arena must hold at least 1 event\n");
+                    return(-12);
+                }
+                break;
+            case 'r':
+                realUnit = atol(optarg);
+                if(realUnit <= 0)
+                {
+                    printf("Real time unit must be at least 1us\n");
+                    return(-12);
+                }
+                break;
+            case 'H':
+                histFilename = optarg;
+                break;
+            case 'M':
+                mergeFilename = optarg;
+                break;
+            case 'i':
+                streamFilename = optarg;
+                break;
+            case 'B':
+                return runBenchmark();
+            default:
+                printf("Usage: %s [-t trace] [-u tick] [-p policy,...] [-q quantum] [-c cores]\n", argv[0]);
+                printf("       [-m cost] [-b none|steal|rebalance[:interval]]\n");
+                printf("       [-l events.bin] [-j events.json] [-L events] [-r usec]\n");
+                printf("       [-H histograms.bin] output.txt\n");
+                printf("       %s -S sweep.csv [-w workers] [-t trace]... [-u tick] [-p policy,...]\n", argv[0]);
+                printf("       [-q quantum,...] [-c cores,...] [-m cost,...] [-b balance,...]\n");
+                printf("       [-H histograms.bin]\n");
+                printf("       %s -i input [-u tick] [-p policy] [-q quantum] [-c cores]\n", argv[0]);
+                printf("       [-m cost] [-b balance] [-H histograms.bin] output.csv\n");
+                printf("       %s -M merged.bin histograms.bin...\n", argv[0]);
+                printf("       %s -B\n", argv[0]);
+                printf("Policies: srtf fcfs sjf rr priority mlfq edf all\n");
+                return(option == 'h' ? 0 : -12);
+        }
+    }
+    
+    if(mergeFilename != NULL)
+    {
+        return runMerge(mergeFilename, argv + optind, argc - optind);
+    }
+    
+    // Settings that were not given take their defaults
+    if(params.numPolicies == 0)
+    {
+        parsePolicies(&params, "srtf");
+    }
+    if(grid.numQuanta == 0)
+    {
+        grid.quanta[grid.numQuanta++] = DEFAULT_QUANTUM;
+    }
+    if(grid.numCores == 0)
+    {
+        grid.cores[grid.numCores++] = 1;
+    }
+    if(grid.numCosts == 0)
+    {
+        grid.costs[grid.numCosts++] = 0;
+    }
+    if(grid.numBalances == 0)
+    {
+        grid.balances[0] = BALANCE_STEAL;
+        grid.intervals[grid.numBalances++] = REBALANCE_INTERVAL;
+    }
+    
+    if(sweepFilename != NULL)
+    {
+        return runSweep(&grid, &params, sweepFilename, workers, histFilename);
+    }
+    if(grid.numTraces > 1 || grid.numQuanta > 1 || grid.numCores > 1 || grid.numCosts > 1 || grid.numBalances > 1)
+    {
+        printf("Several values of a setting need a sweep (-S)\n");
+        return(-12);
+    }
+    params.config.quantum = grid.quanta[0];
+    params.config.numCores = grid.cores[0];
+    params.config.migrationCost = grid.costs[0];
+    params.config.balance = grid.balances[0];
+    params.config.interval = grid.intervals[0];
+    
+    // Get output file name from user
+    if(optind < argc && strlen(argv[optind]) < sizeof(params.filename))
+    {
+        strcpy(params.filename, argv[optind]);
+    }
+    else
+    {
+        printf("Missing filename in command line arguments\n");
+        return(-12);
+    }
+    
+    // Schedule a live stream of arrivals instead of a trace
+    if(streamFilename != NULL)
+    {
+        if(params.numPolicies > 1 || grid.numTraces > 0 || realUnit > 0 || logFilename != NULL || jsonFilename != NULL)
+        {
+            printf("A stream (-i) is scheduled by one policy, without a trace, real run or event log\n");
+            return(-12);
+        }
+        return runStream(&params, streamFilename, histFilename);
+    }
+    
+    // Set input data for CPU scheduling from the trace or the default table
+    loadProcesses(&params, grid.traces[0]);
+    if(realUnit > 0 && (params.config.numCores > 1 || params.numProcesses > REAL_MAX_PROCESSES))
+    {
+        printf("Real execution needs one core and at most %d processes\n", REAL_MAX_PROCESSES);
+        return(-12);
+    }
+    
+    // Allocate the whole event arena now, so logging never allocates
+    if(logFilename != NULL || jsonFilename != NULL)
+    {
+        params.log.events = malloc(params.log.capacity * sizeof(Sim_Event));
+        if(params.log.events == NULL)
+        {
+            perror("Error allocating event arena");
+            return(-13);
+        }
+    }
+    
+    /* creating a named pipe(FIFO) with read/write permission */
+    makefifo = mkfifo(NAME_OF_FIFO, 0666);
+    if((makefifo == -1) && (errno != EEXIST))
+    {
+        perror("Error creating named pipe");
+        return(-11);
+    }
+    
+    // Open FIFO for reading and writing, the reader first so neither open waits, then
+    // let both ends block so the threads wait on each other rather than on a timer
+    params.readFIFO  = open(NAME_OF_FIFO, O_RDONLY | O_NONBLOCK);
+    params.writeFIFO = open(NAME_OF_FIFO, O_WRONLY);
+    if(params.readFIFO < 0 || params.writeFIFO < 0 || fcntl(params.readFIFO, F_SETFL, 0) < 0)
+    {
+        perror("Error opening FIFO");
+        return(-11);
+    }
+    
+    // Output banner to the console
+    outputWelcome();
+    if(grid.numTraces > 0)
+    {
+        snprintf(value, sizeof(value), "%d", params.numProcesses);
+        outputHeader();
+        outputVar("Processes loaded from trace: ", 'Y', value);
+        outputFooter();
+    }
+    
+    /* create threads */
+    if(pthread_create(&thread1, NULL, worker1, (void*)(&params)) != 0)
+    {
+        printf("Thread 1 created error\n");
+        return -1;
+    }
+    if(pthread_create(&thread2, NULL, worker2, (void*)(&params)) != 0)
+    {
+        printf("Thread 2 created error\n");
+        return -2;
+    }
+    
+    /* wait for threads to exit */
+    if(pthread_join(thread1, NULL) != 0)
+    {
+        printf("Join thread 1 error\n");
+        return -3;
+    }
+    if(pthread_join(thread2, NULL) != 0)
+    {
+        printf("Join thread 2 error\n");
+        return -4;
+    }
+    
+    /* close the FIFO, worker1 has closed its end */
+    close(params.readFIFO);
+    
+    // Run the policies for real once the simulation is done
+    if(realUnit > 0)
+    {
+        realCompare(&params, realUnit);
+    }
+    
+    // Save the histograms and events once every run is done
+    if(histFilename != NULL)
+    {
+        histExport(params.results, params.numPolicies, histFilename);
+    }
+    if(logFilename != NULL)
+    {
+        writeEventLog(&(params.log), logFilename);
+    }
+    if(jsonFilename != NULL)
+    {
+        writeChromeTrace(&params, jsonFilename);
+    }
+    if(params.log.events != NULL)
+    {
+        snprintf(value, sizeof(value), "%ld (%ld dropped)", params.log.count, params.log.dropped);
+        outputHeader();
+        outputVar("Events logged: ", 'Y', value);
+        outputFooter();
+        free(params.log.events);
+    }
+    
+    /* delete the FIFO */
+    if(unlink(NAME_OF_FIFO) < 0)
+    {
+        perror("Error deleting to FIFO");
+        return -6;
+    }
+    
+    for(i = 0; i < params.numPolicies; i++)
+    {
+        free(params.results[i].cores);
+    }
+    free(params.processes);
+    
+    return 0;
+}
+
+
+/* this function runs the scheduling policies, streams the processes to the FIFO as they finish */
+void *worker1(void *params)
+{
+    Thread_Params *worker1_params = (Thread_Params *)(params);
+    int count = worker1_params->numProcesses;
+    
+    Record_Writer writer;
+    uint64_t *arrivals;
+    int i;
+    
+    writer.fd = worker1_params->writeFIFO;
+    writer.count = 0;
+    
+    // Queue the processes by arrival once for every policy
+    arrivals = sortArrivals(worker1_params->processes, count);
+    
+    for(i = 0; i < worker1_params->numPolicies; i++)
+    {
+        writer.policy = i;
+        worker1_params->log.policy = i;
+        runPolicy(worker1_params->processes, count, arrivals, &(worker1_params->config),
+            &(worker1_params->results[i]), &writer, (worker1_params->log.events != NULL) ? &(worker1_params->log) : NULL);
+    }
+    
+    free(arrivals);
+    
+    // Send what is left, then close the FIFO so worker2 sees its end
+    recordFlush(&writer);
+    close(worker1_params->writeFIFO);
+    
+    pthread_exit(NULL);
+}
+
+/* reads the waiting time and turn-around time through the FIFO and writes to text file */
+void *worker2(void *params)
+{
+    Thread_Params *worker2_params = (Thread_Params *)(params);
+    int numPolicies = worker2_params->numPolicies;
+    int numCores = worker2_params->config.numCores;
+    Policy_Result *result;
+    Core_State *core;
+    
+    FILE* writeTxt;
+    char value[64];
+    int rows, coreRows;
+    double simTime = 0.0;
+    
+    float avg_wait_t[MAX_POLICIES];
+    float avg_turnaround_t[MAX_POLICIES];
+    double total_wait_t[MAX_POLICIES] = {0.0}, total_turnaround_t[MAX_POLICIES] = {0.0};
+    long completed[MAX_POLICIES] = {0};
+    int table_wait_t[TABLE_ROWS], table_turnaround_t[TABLE_ROWS];
+    
+    Completion_Record records[RECORDS_PER_WRITE + 1], *record;
+    size_t have = 0, used;
+    ssize_t got;
+    
+    // Open file to output data
+    writeTxt = fopen(worker2_params->filename, "w");
+    if(writeTxt == NULL)
+    {
+        perror("Error opening file");
+        exit(-1);
+    }
+    
+    outputHeader();
+    outputLine("Calculated Times", 'Y');
+    outputFooter();
+    
+    // Read the finished processes from the FIFO as they come, until worker1 closes it
+    while((got = read(worker2_params->readFIFO, (char *)records + have, sizeof(records) - have)) != 0)
+    {
+        if(got < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("Error reading from FIFO");
+            exit(-1);
+        }
+        have += got;
+        
+        // Add up every whole record, a part of one waits for the rest
+        for(used = 0; have - used >= sizeof(Completion_Record); used += sizeof(Completion_Record))
+        {
+            record = (Completion_Record *)((char *)records + used);
+            if(record->policy < 0 || record->policy >= numPolicies)
+            {
+                printf("Bad completion record in FIFO\n");
+                exit(-1);
+            }
+            total_wait_t[record->policy]       += record->wait_t;
+            total_turnaround_t[record->policy] += record->turnaround_t;
+            completed[record->policy]++;
+            if(record->policy == 0 && record->index < TABLE_ROWS)
+            {
+                table_wait_t[record->index]       = record->wait_t;
+                table_turnaround_t[record->index] = record->turnaround_t;
+            }
+        }
+        have -= used;
+        memmove(records, (char *)records + used, have);
+    }
+    
+    int i;
+    
+    for(i = 0; i < numPolicies; i++)
+    {
+        if(completed[i] != worker2_params->numProcesses)
+        {
+            printf("FIFO ended after %ld of %d processes\n", completed[i], worker2_params->numProcesses);
+            exit(-1);
+        }
+        avg_wait_t[i]       = total_wait_t[i] / completed[i];
+        avg_turnaround_t[i] = total_turnaround_t[i] / completed[i];
+        
+        if(numPolicies == 1)
+        {
+            printf("Average wait time: %fs\n", avg_wait_t[i]);
+            printf("Average turnaround time: %fs\n", avg_turnaround_t[i]);
+        }
+        else
+        {
+            printf("Average wait time (%s): %fs\n", worker2_params->results[i].policy->name, avg_wait_t[i]);
+            printf("Average turnaround time (%s): %fs\n", worker2_params->results[i].policy->name, avg_turnaround_t[i]);
+        }
+    }
+    
+    // Output CPU scheduling results table
+    outputHeader();
+    if(numPolicies == 1)
+    {
+        outputLine("Process Schedule Table", 'Y');
+    }
+    else
+    {
+        snprintf(value, sizeof(value), "Process Schedule Table (%s)", worker2_params->results[0].policy->name);
+        outputLine(value, 'Y');
+    }
+    
+    printf("╠═════════╦═══════════════╦═══════════════╦═══════════════╦═══════════════════╣\n");
+    printf("║ ID      ║ Arrival Time  ║ Burst Time    ║ Wait Time     ║ Turnaround Time   ║\n");
+    printf("╠═════════╬═══════════════╬═══════════════╬═══════════════╬═══════════════════╣\n");
+    
+    // Large traces only show their first rows
+    rows = (worker2_params->numProcesses < TABLE_ROWS) ? worker2_params->numProcesses : TABLE_ROWS;
+    for(i = 0; i < rows; i++) 
+    {
+        printf(
+            "║ %d\t  ║ %d\t\t  ║ %d\t\t  ║ %d\t\t  ║ %d\t\t      ║\n", 
+            (worker2_params->processes[i].pid),
+            (worker2_params->processes[i].arrive_t), 
+            (worker2_params->processes[i].burst_t), 
+            (table_wait_t[i]), 
+            (table_turnaround_t[i])
+        );
+    }
+    
+    printf("╚═════════╩═══════════════╩═══════════════╩═══════════════╩═══════════════════╝\n");
+    
+    // Output what each core did under the first policy
+    coreRows = (numCores < TABLE_ROWS) ? numCores : TABLE_ROWS;
+    if(numCores > 1)
+    {
+        result = &(worker2_params->results[0]);
+        outputHeader();
+        snprintf(value, sizeof(value), "Core Utilisation (%s)", result->policy->name);
+        outputLine(value, 'Y');
+        
+        printf("╠═════════╦═══════════════╦═══════════════╦═══════════════╦═══════════════════╣\n");
+        printf("║ Core    ║ Busy Time     ║ Utilisation   ║ Completed     ║ Migrations In     ║\n");
+        printf("╠═════════╬═══════════════╬═══════════════╬═══════════════╬═══════════════════╣\n");
+        
+        for(i = 0; i < coreRows; i++)
+        {
+            core = &(result->cores[i]);
+            snprintf(value, sizeof(value), "%.2f%%", (result->makespan > 0) ? 100.0 * core->busy_t / result->makespan : 0.0);
+            printf("║ %-7d ║ %-13lld ║ %-13s ║ %-13ld ║ %-17ld ║\n", i, core->busy_t, value, core->completed, core->migrations);
+        }
+        
+        printf("╚═════════╩═══════════════╩═══════════════╩═══════════════╩═══════════════════╝\n");
+    }
+    
+    // Output the policies side by side
+    if(numPolicies > 1)
+    {
+        outputHeader();
+        outputLine("Policy Comparison (average times)", 'Y');
+        
+        printf("╠═══════════╦═════════════╦═════════════╦═══════════╦═══════════╦═════════════╣\n");
+        printf("║ Policy    ║ Wait Time   ║ Turnaround  ║ p99 Wait  ║ Max Wait  ║ Preemptions ║\n");
+        printf("╠═══════════╬═════════════╬═════════════╬═══════════╬═══════════╬═════════════╣\n");
+        
+        for(i = 0; i < numPolicies; i++)
+        {
+            result = &(worker2_params->results[i]);
+            printf("║ %-9s ║ %-11f ║ %-11f ║ %-9d ║ %-9d ║ %-11ld ║\n", result->policy->name, avg_wait_t[i],
+                avg_turnaround_t[i], result->p99_wait_t, result->max_wait_t, result->preemptions);
+        }
+        
+        printf("╚═══════════╩═════════════╩═════════════╩═══════════╩═══════════╩═════════════╝\n");
+    }
+    
+    // Output the tail of each policy's times
+    outputHeader();
+    outputLine("Latency Percentiles", 'Y');
+    outputPercentileHeader();
+    for(i = 0; i < numPolicies; i++)
+    {
+        result = &(worker2_params->results[i]);
+        snprintf(value, sizeof(value), "%s wait", result->policy->name);
+        outputPercentiles(value, &(result->wait));
+        snprintf(value, sizeof(value), "%s turnaround", result->policy->name);
+        outputPercentiles(value, &(result->turnaround));
+        snprintf(value, sizeof(value), "%s response", result->policy->name);
+        outputPercentiles(value, &(result->response));
+    }
+    outputPercentileFooter();
+    
+    // Output how the run went
+    outputHeader();
+    if(rows < worker2_params->numProcesses)
+    {
+        snprintf(value, sizeof(value), "%d", worker2_params->numProcesses - rows);
+        outputVar("Processes not shown: ", 'Y', value);
+    }
+    if(coreRows < numCores)
+    {
+        snprintf(value, sizeof(value), "%d", numCores - coreRows);
+        outputVar("Cores not shown: ", 'Y', value);
+    }
+    if(numPolicies == 1)
+    {
+        snprintf(value, sizeof(value), "%ld", worker2_params->results[0].preemptions);
+        outputVar("Preemptions: ", 'Y', value);
+        snprintf(value, sizeof(value), "%d / %d", worker2_params->results[0].p99_wait_t, worker2_params->results[0].max_wait_t);
+        outputVar("Wait time p99 / max: ", 'Y', value);
+    }
+    for(i = 0; i < numPolicies && numCores > 1; i++)
+    {
+        if(numPolicies == 1)
+        {
+            snprintf(value, sizeof(value), "%ld", worker2_params->results[i].migrations);
+        }
+        else
+        {
+            snprintf(value, sizeof(value), "%ld (%s)", worker2_params->results[i].migrations,
+                worker2_params->results[i].policy->name);
+        }
+        outputVar("Migrations: ", 'Y', value);
+    }
+    if(worker2_params->tick != 1.0)
+    {
+        snprintf(value, sizeof(value), "%g trace units", worker2_params->tick);
+        outputVar("Tick: ", 'Y', value);
+    }
+    for(i = 0; i < numPolicies; i++)
+    {
+        simTime += worker2_params->results[i].simTime;
+    }
+    snprintf(value, sizeof(value), "%fs", simTime);
+    outputVar("Simulation time: ", 'Y', value);
+    outputFooter();
+    
+    // Write data to file then close it, naming each policy when there are several
+    for(i = 0; i < numPolicies; i++)
+    {
+        if(numPolicies > 1)
+        {
+            fprintf(writeTxt, "%s%s %s\n", (i > 0) ? "\n" : "", "Policy:", worker2_params->results[i].policy->name);
+        }
+        fprintf(writeTxt, "%s %s %s %f", "Average", "wait", "time:", avg_wait_t[i]);
+        fprintf(writeTxt, "%s %s %s %f", "\nAverage", "turnaround", "time:", avg_turnaround_t[i]);
+    }
+    fclose(writeTxt);
+    
+    outputHeader();
+    outputLine("Program transferred data to file", 'Y');
+    outputFooter();
+    
+    pthread_exit(NULL);
+}
+
+/* adds a finished process to the writer, writing a full block to the FIFO */
+void recordWrite(Record_Writer *writer, int index, int pid, int wait_t, int turnaround_t, int completion_t)
+{
+    Completion_Record *record = &(writer->records[writer->count++]);
+    
+    record->policy       = writer->policy;
+    record->index        = index;
+    record->pid          = pid;
+    record->wait_t       = wait_t;
+    record->turnaround_t = turnaround_t;
+    record->completion_t = completion_t;
+    
+    if(writer->count == RECORDS_PER_WRITE)
+    {
+        recordFlush(writer);
+    }
+}
+
+/* writes the records waiting in the writer to the FIFO */
+void recordFlush(Record_Writer *writer)
+{
+    char *data = (char *)writer->records;
+    size_t length = writer->count * sizeof(Completion_Record);
+    ssize_t result;
+    
+    // The FIFO blocks while it is full, so this waits for worker2 to catch up
+    while(length > 0)
+    {
+        result = write(writer->fd, data, length);
+        if(result < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("Error writing to FIFO");
+            exit(-1);
+        }
+        data += result;
+        length -= result;
+    }
+    writer->count = 0;
+}
+
+/* adds a process to the table, growing it as needed */
+void addProcess(Thread_Params *params, int pid, int arrive_t, int burst_t, int priority, int deadline_t)
+{
+    Process_Params *processes;
+    
+    if(params->numProcesses == params->capacity)
+    {
+        params->capacity = (params->capacity == 0) ? 1024 : params->capacity * 2;
+        processes = realloc(params->processes, params->capacity * sizeof(Process_Params));
+        if(processes == NULL)
+        {
+            perror("Error allocating process table");
+            exit(-13);
+        }
+        params->processes = processes;
+    }
+    
+    setProcess(&(params->processes[params->numProcesses]), pid, arrive_t, burst_t, priority, deadline_t);
+    params->numProcesses++;
+}
+
+/* fills in a process after checking its times */
+void setProcess(Process_Params *process, int pid, int arrive_t, int burst_t, int priority, int deadline_t)
+{
+    if(arrive_t < 0 || burst_t <= 0)
+    {
+        printf("Process %d needs an arrive time of 0 or more and a burst time above 0\n", pid);
+        exit(-13);
+    }
+    if(priority < 0 || deadline_t < -1)
+    {
+        printf("Process %d needs a priority of 0 or more and a deadline of 0 or more, or -1 for none\n", pid);
+        exit(-13);
+    }
+    
+    process->pid      = pid;
+    process->arrive_t = arrive_t;
+    process->burst_t  = burst_t;
+    process->priority = priority;
+    process->deadline_t = deadline_t;
+}
+
+/* adds the policies of a comma separated list to the run */
+void parsePolicies(Thread_Params *params, const char *list)
+{
+    const char *name = list;
+    size_t length;
+    int i;
+    
+    while(*name != '\0')
+    {
+        length = strcspn(name, ",");
+        
+        // "all" stands for every policy in table order
+        if(length == 3 && strncmp(name, "all", 3) == 0)
+        {
+            for(i = 0; i < NUM_OF_POLICIES; i++)
+            {
+                parsePolicies(params, policies[i].name);
+            }
+        }
+        else
+        {
+            for(i = 0; i < NUM_OF_POLICIES; i++)
+            {
+                if(strlen(policies[i].name) == length && strncmp(name, policies[i].name, length) == 0)
+                {
+                    break;
+                }
+            }
+            if(i == NUM_OF_POLICIES)
+            {
+                printf("Unknown policy \"%.*s\"\n", (int)length, name);
+                exit(-12);
+            }
+            if(params->numPolicies == MAX_POLICIES)
+            {
+                printf("At most %d policies can be compared in one run\n", MAX_POLICIES);
+                exit(-12);
+            }
+            params->results[params->numPolicies].cores = NULL;
+            params->results[params->numPolicies++].policy = &policies[i];
+        }
+        
+        name += length;
+        if(*name == ',')
+        {
+            name++;
+        }
+    }
+}
+
+/* reads a comma separated list of whole numbers into values, returns how many */
+int parseValues(const char *list, int *values, int minimum, int maximum, const char *name)
+{
+    const char *text = list;
+    char *end;
+    long value;
+    int count = 0;
+    
+    while(*text != '\0')
+    {
+        errno = 0;
+        value = strtol(text, &end, 10);
+        if(end == text || errno != 0 || value < minimum || value > maximum || (*end != ',' && *end != '\0'))
+        {
+            printf("%s must be between %d and %d\n", name, minimum, maximum);
+            exit(-12);
+        }
+        if(count == MAX_GRID_VALUES)
+        {
+            printf("At most %d values of %s can be given\n", MAX_GRID_VALUES, name);
+            exit(-12);
+        }
+        values[count++] = value;
+        
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+/* reads a comma separated list of load balancing into the grid */
+void parseBalances(Sim_Grid *grid, const char *list)
+{
+    char text[64];
+    size_t length;
+    
+    grid->numBalances = 0;
+    while(*list != '\0')
+    {
+        length = strcspn(list, ",");
+        if(length >= sizeof(text) || grid->numBalances == MAX_GRID_VALUES)
+        {
+            printf("Unknown load balancing \"%.*s\"\n", (int)length, list);
+            exit(-12);
+        }
+        memcpy(text, list, length);
+        text[length] = '\0';
+        parseBalance(text, &(grid->balances[grid->numBalances]), &(grid->intervals[grid->numBalances]));
+        grid->numBalances++;
+        
+        list += length;
+        if(*list == ',')
+        {
+            list++;
+        }
+    }
+}
+
+/* reads one load balancing of -b */
+void parseBalance(const char *text, int *balance, int *interval)
+{
+    *interval = REBALANCE_INTERVAL;
+    if(strcmp(text, "none") == 0)
+    {
+        *balance = BALANCE_NONE;
+    }
+    else if(strcmp(text, "steal") == 0)
+    {
+        *balance = BALANCE_STEAL;
+    }
+    else if(strncmp(text, "rebalance", 9) == 0 && (text[9] == '\0' || text[9] == ':'))
+    {
+        *balance = BALANCE_REBALANCE;
+        if(text[9] == ':')
+        {
+            *interval = atoi(text + 10);
+        }
+        if(*interval <= 0)
+        {
+            printf("Rebalance interval must be a time above 0\n");
+            exit(-12);
+        }
+    }
+    else
+    {
+        printf("Unknown load balancing \"%s\"\n", text);
+        exit(-12);
+    }
+}
+
+/* loads the processes of a trace, or the default table without one, and checks them */
+void loadProcesses(Thread_Params *params, const char *filename)
+{
+    long long span = 0, totalBurst = 0;
+    int i;
+    
+    if(filename != NULL)
+    {
+        loadTrace(params, filename);
+    }
+    else
+    {
+        for(i = 0; i < NUM_OF_DEFAULT_PROCESSES; i++)
+        {
+            addProcess(params, defaultProcesses[i][0], defaultProcesses[i][1], defaultProcesses[i][2], 0, -1);
+        }
+    }
+    if(params->numProcesses == 0)
+    {
+        printf("%s: no processes to schedule\n", filename);
+        exit(-13);
+    }
+    
+    //Check the whole run fits the clock
+    for(i = 0; i < params->numProcesses; i++) 
+    {
+        totalBurst += params->processes[i].burst_t;
+        if(params->processes[i].arrive_t > span)
+        {
+            span = params->processes[i].arrive_t;
+        }
+    }
+    if(span + totalBurst > INT_MAX)
+    {
+        printf("%s: trace runs past the largest number of ticks the scheduler can count (%d), "
+            "try a longer tick (-u)\n", filename, INT_MAX);
+        exit(-13);
+    }
+}
+
+/* loads the processes of a text or binary trace file */
+void loadTrace(Thread_Params *params, const char *filename)
+{
+    FILE *trace;
+    char magic[sizeof(TRACE_MAGIC) - 1];
+    
+    trace = fopen(filename, "rb");
+    if(trace == NULL)
+    {
+        perror(filename);
+        exit(-13);
+    }
+    
+    // Binary traces are known by their magic, anything else is read as text
+    if(fread(magic, 1, sizeof(magic), trace) == sizeof(magic) && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0)
+    {
+        loadBinaryTrace(params, trace, filename);
+    }
+    else
+    {
+        rewind(trace);
+        loadTextTrace(params, trace, filename);
+    }
+    
+    fclose(trace);
+}
+
+/* loads the records of a binary trace after its magic */
+void loadBinaryTrace(Thread_Params *params, FILE *trace, const char *filename)
+{
+    Trace_Record records[4096];
+    uint64_t count, i;
+    size_t got, j;
+    
+    if(fread(&count, sizeof(count), 1, trace) != 1 || count > INT_MAX)
+    {
+        printf("%s: bad process count in binary trace\n", filename);
+        exit(-13);
+    }
+    
+    // Size the table once, then read the records in blocks
+    params->capacity = count;
+    params->processes = malloc((count > 0 ? count : 1) * sizeof(Process_Params));
+    if(params->processes == NULL)
+    {
+        perror("Error allocating process table");
+        exit(-13);
+    }
+    
+    for(i = 0; i < count; i += got)
+    {
+        got = fread(records, sizeof(Trace_Record), (count - i < 4096) ? count - i : 4096, trace);
+        if(got == 0)
+        {
+            printf("%s: binary trace ends after %llu of %llu processes\n", filename,
+                (unsigned long long)i, (unsigned long long)count);
+            exit(-13);
+        }
+        for(j = 0; j < got; j++)
+        {
+            addProcess(params, records[j].pid, traceTicks(records[j].arrive_t, params->tick, false, filename),
+                traceTicks(records[j].burst_t, params->tick, true, filename), 0, -1);
+        }
+    }
+}
+
+/* loads the "pid,arrive,burst[,priority[,deadline]]" lines of a text trace */
+void loadTextTrace(Thread_Params *params, FILE *trace, const char *filename)
+{
+    char line[TRACE_LINE_SIZE];
+    double fields[5];
+    int lineNumber = 0, parsed;
+    
+    while(fgets(line, sizeof(line), trace) != NULL)
+    {
+        lineNumber++;
+        parsed = parseTraceLine(line, fields, params->numProcesses == 0);
+        if(parsed < 0)
+        {
+            printf("%s:%d: expected pid, arrive time and burst time, then optional priority and deadline\n",
+                filename, lineNumber);
+            exit(-13);
+        }
+        if(parsed > 0)
+        {
+            addProcess(params, fields[0], traceTicks(fields[1], params->tick, false, filename),
+                traceTicks(fields[2], params->tick, true, filename), fields[3],
+                traceTicks(fields[4], params->tick, true, filename));
+        }
+    }
+}
+
+/* reads a "pid,arrive,burst[,priority[,deadline]]" line into fields, returns 1 for a process, 0 for a
+ * line to skip and -1 for one that cannot be read, a header line only being skipped before the first process */
+int parseTraceLine(char *line, double *fields, bool first)
+{
+    char *text, *end;
+    int i;
+    
+    // Skip blank lines, comments and a header line of names
+    for(text = line; *text == ' ' || *text == '\t'; text++);
+    if(*text == '\0' || *text == '\n' || *text == '\r' || *text == '#'
+        || (first && (*text < '0' || *text > '9') && *text != '-'))
+    {
+        return 0;
+    }
+    
+    // Read three numbers separated by commas or spaces, then the priority and deadline if given
+    fields[3] = 0;
+    fields[4] = -1;
+    for(i = 0; i < 5; i++)
+    {
+        while(*text == ',' || *text == ' ' || *text == '\t')
+        {
+            text++;
+        }
+        if(i >= 3 && (*text == '\0' || *text == '\n' || *text == '\r' || *text == '#'))
+        {
+            break;
+        }
+        // Times may be decimals or too large for an int until they are made ticks
+        errno = 0;
+        fields[i] = strtod(text, &end);
+        if(end == text || errno != 0 || !(fields[i] >= -1e18 && fields[i] <= 1e18)
+            || ((i == 0 || i == 3) && (fields[i] < INT_MIN || fields[i] > INT_MAX || fields[i] != (int)fields[i])))
+        {
+            return -1;
+        }
+        text = end;
+    }
+    return 1;
+}
+
+/* converts a trace time to ticks, rounding a length of time up and a point in time down */
+int traceTicks(double value, double tick, bool roundUp, const char *filename)
+{
+    double ticks = value / tick;
+    long long whole;
+    
+    // Only a deadline of -1 may be negative, anything else is left for addProcess to refuse
+    if(value < 0)
+    {
+        return (value == -1) ? -1 : INT_MIN;
+    }
+    if(ticks > INT_MAX)
+    {
+        printf("%s: time %.0f is past the largest number of ticks the scheduler can count (%d), "
+            "try a longer tick (-u)\n", filename, value, INT_MAX);
+        exit(-13);
+    }
+    
+    whole = ticks;
+    if(roundUp && whole < ticks)
+    {
+        whole++;
+    }
+    return whole;
+}
+
+/* returns the processes as arrive time and index keys sorted by arrival */
+uint64_t *sortArrivals(Process_Params *processes, int count)
+{
+    uint64_t *arrivals = malloc(count * sizeof(uint64_t));
+    uint64_t *sorted, *swap;
+    size_t offsets[256], total;
+    int i, shift, inOrder = 1;
+    
+    if(arrivals == NULL)
+    {
+        perror("Error allocating arrival queue");
+        exit(-1);
+    }
+    
+    // The index in the low bits keeps processes that arrive together in table order
+    for(i = 0; i < count; i++)
+    {
+        arrivals[i] = ((uint64_t)processes[i].arrive_t << 32) | (uint32_t)i;
+        if(i > 0 && arrivals[i] < arrivals[i - 1])
+        {
+            inOrder = 0;
+        }
+    }
+    
+    // Traces are usually already in arrival order
+    if(inOrder)
+    {
+        return arrivals;
+    }
+    
+    sorted = malloc(count * sizeof(uint64_t));
+    if(sorted == NULL)
+    {
+        perror("Error allocating arrival queue");
+        exit(-1);
+    }
+    
+    // Radix sort the arrive times a byte at a time, each pass keeps the order of the last
+    for(shift = 32; shift < 64; shift += 8)
+    {
+        memset(offsets, 0, sizeof(offsets));
+        for(i = 0; i < count; i++)
+        {
+            offsets[(arrivals[i] >> shift) & 0xFF]++;
+        }
+        for(i = 0, total = 0; i < 256; i++)
+        {
+            total += offsets[i];
+            offsets[i] = total - offsets[i];
+        }
+        for(i = 0; i < count; i++)
+        {
+            sorted[offsets[(arrivals[i] >> shift) & 0xFF]++] = arrivals[i];
+        }
+        
+        swap = arrivals;
+        arrivals = sorted;
+        sorted = swap;
+    }
+    free(sorted);
+    
+    return arrivals;
+}
+
+/* runs one policy over the processes, leaving its wait and turnaround times in the table */
+void runPolicy(Process_Params *processes, int count, const uint64_t *arrivals, const Sim_Config *config,
+    Policy_Result *result, Record_Writer *writer, Event_Log *log)
+{
+    double total_wait_t = 0.0, total_turnaround_t = 0.0;
+    
+    Sim_State sim;
+    int next = 0, done = 0, i;
+    struct timespec start, end;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    simStart(&sim, processes, count, config, result->policy, log);
+    
+    //Initialise remaining time to be same as burst time, no process has had a CPU yet
+    for(i = 0; i < count; i++)
+    {
+        processes[i].remain_t = processes[i].burst_t;
+        processes[i].response_t = -1;
+    }
+    histReset(&(result->wait));
+    histReset(&(result->turnaround));
+    histReset(&(result->response));
+    
+    //Run function until every process is finished
+    while(done < count)
+    {
+        //Jump to the next time anything happens, instead of idling in between
+        sim.time = simNextTime(&sim, config, (next < count) ? (long long)(arrivals[next] >> 32) : LLONG_MAX);
+        
+        //Save time information of every process finished now and add to totals
+        while((i = simStop(&sim)) >= 0)
+        {
+            done++;
+            simCompleted(&sim, result, i);
+            
+            total_wait_t       += processes[i].wait_t;
+            
+            total_turnaround_t += processes[i].turnaround_t;
+            
+            if(writer != NULL)
+            {
+                recordWrite(writer, i, processes[i].pid, processes[i].wait_t, processes[i].turnaround_t, sim.time);
+            }
+        }
+        
+        //Queue every process that has arrived on the cores in turn
+        while(next < count && (int)(arrivals[next] >> 32) <= sim.time)
+        {
+            simArrive(&sim, (uint32_t)arrivals[next], next % sim.numCores);
+            next++;
+        }
+        simSettle(&sim, config);
+    }
+    
+    simFinish(&sim, result);
+    
+    result->p99_wait_t = histPercentile(&(result->wait), 0.99);
+    result->max_wait_t = result->wait.max;
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    result->simTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    
+    result->avg_wait_t       = total_wait_t / count;
+    result->avg_turnaround_t = total_turnaround_t / count;
+}
+
+/* sets up a run with every core idle, for up to count processes */
+void simStart(Sim_State *sim, Process_Params *processes, int count, const Sim_Config *config,
+    const Sched_Policy *policy, Event_Log *log)
+{
+    int i;
+    
+    sim->processes = processes;
+    sim->policy = policy;
+    sim->time = 0;
+    sim->quantum = config->quantum;
+    sim->sequence = 0;
+    sim->level = NULL;
+    sim->numCores = config->numCores;
+    sim->numPending = 0;
+    sim->migrationCost = config->migrationCost;
+    sim->queued = 0;
+    sim->idle = config->numCores;
+    sim->preemptions = 0;
+    sim->log = log;
+    sim->order = NULL;
+    for(sim->leaves = 1; sim->leaves < sim->numCores; sim->leaves *= 2);
+    
+    sim->cores = calloc(sim->numCores, sizeof(Core_State));
+    sim->tree = malloc(2 * sim->leaves * sizeof(int));
+    sim->pending = malloc(sim->numCores * sizeof(int));
+    if(policy->expired != NULL)
+    {
+        sim->level = calloc(count, sizeof(unsigned char));
+    }
+    if(sim->cores == NULL || sim->tree == NULL || sim->pending == NULL || (policy->expired != NULL && sim->level == NULL))
+    {
+        perror("Error allocating cores");
+        exit(-1);
+    }
+    
+    // Every core starts idle, the tree's spare leaves hold no core
+    for(i = 0; i < sim->numCores; i++)
+    {
+        sim->cores[i].running = -1;
+        sim->cores[i].expired = -1;
+        sim->cores[i].requeue = -1;
+        sim->cores[i].stop = LLONG_MAX;
+    }
+    for(i = 0; i < sim->leaves; i++)
+    {
+        sim->tree[sim->leaves + i] = (i < sim->numCores) ? i : -1;
+    }
+    for(i = sim->leaves - 1; i > 0; i--)
+    {
+        sim->tree[i] = sim->tree[2 * i];
+    }
+}
+
+/* returns the next time a core stops, the next process arrives or, with processes waiting,
+ * the run queues are rebalanced */
+__attribute__((always_inline))
+inline long long simNextTime(Sim_State *sim, const Sim_Config *config, long long arrival)
+{
+    int top = sim->tree[1];
+    long long nextTime = (top >= 0) ? sim->cores[top].stop : LLONG_MAX, tick;
+    
+    if(arrival < nextTime)
+    {
+        nextTime = arrival;
+    }
+    if(config->balance == BALANCE_REBALANCE && sim->queued > 0)
+    {
+        tick = ((long long)sim->time / config->interval + 1) * config->interval;
+        if(tick < nextTime)
+        {
+            nextTime = tick;
+        }
+    }
+    return nextTime;
+}
+
+/* takes the process off each core that finishes it or ends its slice now, returning the
+ * next one that is finished, or -1 once there are none */
+__attribute__((always_inline))
+inline int simStop(Sim_State *sim)
+{
+    Core_State *core;
+    int top, i;
+    
+    while((top = sim->tree[1]) >= 0 && sim->cores[top].stop == sim->time)
+    {
+        core = &(sim->cores[top]);
+        coreCharge(sim, top);
+        i = core->running;
+        core->running = -1;
+        sim->idle++;
+        coreUpdate(sim, top);
+        if(!core->pending)
+        {
+            core->pending = true;
+            sim->pending[sim->numPending++] = top;
+        }
+        
+        //Slice is used up, queue it again behind the processes arriving now
+        if(sim->processes[i].remain_t > 0)
+        {
+            logEvent(sim, EVENT_SLICE_END, top, i);
+            core->requeue = i;
+            continue;
+        }
+        
+        logEvent(sim, EVENT_COMPLETE, top, i);
+        core->completed++;
+        return i;
+    }
+    return -1;
+}
+
+/* works out the wait and turnaround times of a finished process and counts them */
+__attribute__((always_inline))
+inline void simCompleted(Sim_State *sim, Policy_Result *result, int index)
+{
+    Process_Params *process = &(sim->processes[index]);
+    
+    process->turnaround_t = sim->time - process->arrive_t;
+    
+    process->wait_t       = sim->time - process->burst_t - process->arrive_t;
+    
+    histRecord(&(result->wait), process->wait_t);
+    histRecord(&(result->turnaround), process->turnaround_t);
+    histRecord(&(result->response), process->response_t);
+}
+
+/* queues an arriving process on a core, unless the policy gives it that core's CPU */
+__attribute__((always_inline))
+inline void simArrive(Sim_State *sim, int index, int target)
+{
+    const Sched_Policy *policy = sim->policy;
+    Core_State *core = &(sim->cores[target]);
+    
+    if(core->running >= 0 && policy->preempts != NULL)
+    {
+        coreCharge(sim, target);
+        if(policy->preempts(sim, index, core->running))
+        {
+            //Only a process that has already had the CPU is preempted
+            if(core->dispatched < sim->time)
+            {
+                sim->preemptions++;
+            }
+            logEvent(sim, EVENT_PREEMPT, target, core->running);
+            logEvent(sim, EVENT_DISPATCH, target, index);
+            coreQueue(sim, target, core->running);
+            core->running = index;
+            sim->processes[index].response_t = 0;
+            core->dispatched = sim->time;
+            core->sliceEnd = (policy->slice != NULL) ? (long long)sim->time + policy->slice(sim, index) : LLONG_MAX;
+            coreUpdate(sim, target);
+            return;
+        }
+    }
+    coreQueue(sim, target, index);
+}
+
+/* queues the processes that used up their slice, gives the idle cores work and evens out the queues */
+__attribute__((always_inline))
+inline void simSettle(Sim_State *sim, const Sim_Config *config)
+{
+    Core_State *core;
+    int i;
+    
+    //Queue the processes that used up their slice, then give the idle cores work
+    for(i = 0; i < sim->numPending; i++)
+    {
+        core = &(sim->cores[sim->pending[i]]);
+        if(core->requeue >= 0)
+        {
+            if(sim->policy->expired != NULL)
+            {
+                sim->policy->expired(sim, core->requeue);
+            }
+            coreQueue(sim, sim->pending[i], core->requeue);
+            core->expired = core->requeue;
+            core->requeue = -1;
+        }
+    }
+    dispatchPending(sim);
+    
+    //Even out the run queues
+    if(config->balance == BALANCE_STEAL && sim->idle > 0 && sim->queued > 0)
+    {
+        stealWork(sim);
+        dispatchPending(sim);
+    }
+    else if(config->balance == BALANCE_REBALANCE && sim->time % config->interval == 0 && sim->queued > 0)
+    {
+        rebalance(sim);
+        dispatchPending(sim);
+    }
+}
+
+/* drops the run queues, keeping what each core did in the result */
+void simFinish(Sim_State *sim, Policy_Result *result)
+{
+    int i;
+    
+    result->migrations = 0;
+    for(i = 0; i < sim->numCores; i++)
+    {
+        free(sim->cores[i].heap);
+        sim->cores[i].heap = NULL;
+        result->migrations += sim->cores[i].migrations;
+    }
+    free(result->cores);
+    result->cores = sim->cores;
+    result->preemptions = sim->preemptions;
+    result->makespan = sim->time;
+    
+    free(sim->tree);
+    free(sim->pending);
+    free(sim->level);
+}
+
+/* returns the arrival order of a process */
+uint32_t simOrder(Sim_State *sim, int index)
+{
+    return (sim->order != NULL) ? sim->order[index] : (uint32_t)index;
+}
+
+/* schedules the processes of a live stream as they arrive, writing each one out as it finishes */
+int runStream(Thread_Params *params, const char *input, const char *histFilename)
+{
+    Stream_State stream;
+    Policy_Result *result = &(params->results[0]);
+    char *buffer, *line, *end;
+    char value[64];
+    double fields[5];
+    size_t have = 0;
+    ssize_t got;
+    long long started, arrived;
+    int fd, lineNumber = 0, parsed, i;
+    bool last = false;
+    
+    stream.config = &(params->config);
+    stream.result = result;
+    stream.input = input;
+    stream.tick = params->tick;
+    stream.capacity = STREAM_START_SLOTS;
+    stream.numFree = 0;
+    stream.numFinished = 0;
+    stream.finishedCapacity = STREAM_START_SLOTS;
+    stream.live = 0;
+    stream.peak = 0;
+    stream.work = 0;
+    stream.arrivals = 0;
+    stream.done = 0;
+    stream.late = 0;
+    stream.total_wait_t = 0.0;
+    stream.total_turnaround_t = 0.0;
+    stream.started = false;
+    histReset(&(stream.decision));
+    histReset(&(result->wait));
+    histReset(&(result->turnaround));
+    histReset(&(result->response));
+    
+    // Slots are handed out lowest first, the stream growing them only when every one is live
+    simStart(&(stream.sim), malloc(stream.capacity * sizeof(Process_Params)), stream.capacity,
+        stream.config, result->policy, NULL);
+    stream.sim.order = malloc(stream.capacity * sizeof(uint32_t));
+    stream.freeSlots = malloc(stream.capacity * sizeof(int));
+    stream.finished = malloc(stream.finishedCapacity * sizeof(Completion_Record));
+    buffer = malloc(STREAM_BUFFER_SIZE);
+    if(stream.sim.processes == NULL || stream.sim.order == NULL || stream.freeSlots == NULL
+        || stream.finished == NULL || buffer == NULL)
+    {
+        perror("Error allocating process slots");
+        return(-13);
+    }
+    for(i = stream.capacity - 1; i >= 0; i--)
+    {
+        stream.freeSlots[stream.numFree++] = i;
+    }
+    
+    // Finished processes go to stdout for -, moving the console output to stderr
+    if(strcmp(params->filename, "-") == 0)
+    {
+        stream.output = fdopen(dup(STDOUT_FILENO), "w");
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+    else
+    {
+        stream.output = fopen(params->filename, "w");
+    }
+    if(stream.output == NULL)
+    {
+        perror("Error opening file");
+        return(-1);
+    }
+    setvbuf(stream.output, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+    fprintf(stream.output, "pid,arrive,burst,wait,turnaround,completion\n");
+    
+    // Read from stdin, or a named pipe made if it does not exist yet
+    if(strcmp(input, "-") == 0)
+    {
+        fd = STDIN_FILENO;
+    }
+    else
+    {
+        if(mkfifo(input, 0666) == -1 && errno != EEXIST)
+        {
+            perror("Error creating named pipe");
+            return(-11);
+        }
+        fd = open(input, O_RDONLY);
+        if(fd < 0)
+        {
+            perror("Error opening input");
+            return(-11);
+        }
+    }
+    
+    outputWelcome();
+    snprintf(value, sizeof(value), "%s (%s)", input, result->policy->name);
+    outputHeader();
+    outputVar("Streaming arrivals from: ", 'Y', value);
+    outputFooter();
+    fflush(stdout);
+    
+    // Schedule every whole line as it is read, keeping a part of one for the next read
+    started = clockNs(CLOCK_MONOTONIC);
+    while(!last)
+    {
+        got = read(fd, buffer + have, STREAM_BUFFER_SIZE - have);
+        if(got < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("Error reading arrivals");
+            exit(-1);
+        }
+        have += got;
+        
+        // The last line may end without a newline
+        if(got == 0)
+        {
+            last = true;
+            if(have > 0)
+            {
+                buffer[have++] = '\n';
+            }
+        }
+        
+        line = buffer;
+        while((end = memchr(line, '\n', buffer + have - line)) != NULL)
+        {
+            *end = '\0';
+            lineNumber++;
+            parsed = parseTraceLine(line, fields, stream.arrivals == 0);
+            if(parsed < 0)
+            {
+                printf("%s:%d: expected pid, arrive time and burst time, then optional priority and deadline\n",
+                    input, lineNumber);
+                exit(-13);
+            }
+            if(parsed > 0)
+            {
+                arrived = clockNs(CLOCK_MONOTONIC);
+                streamArrive(&stream, fields);
+                histRecord(&(stream.decision), clockNs(CLOCK_MONOTONIC) - arrived);
+            }
+            line = end + 1;
+        }
+        have -= line - buffer;
+        memmove(buffer, line, have);
+        if(have >= STREAM_BUFFER_SIZE - 1)
+        {
+            printf("%s:%d: line is too long\n", input, lineNumber + 1);
+            exit(-13);
+        }
+        
+        // Hand over what has finished before waiting for more arrivals
+        streamWrite(&stream);
+    }
+    
+    // No more arrivals, so run the processes left to the end
+    streamAdvance(&stream, LLONG_MAX);
+    streamWrite(&stream);
+    simFinish(&(stream.sim), result);
+    result->simTime = (clockNs(CLOCK_MONOTONIC) - started) / 1e9;
+    
+    if(fd != STDIN_FILENO)
+    {
+        close(fd);
+    }
+    if(ferror(stream.output) || fclose(stream.output) != 0)
+    {
+        perror("Error writing finished processes");
+        return(-1);
+    }
+    
+    // Output the summary of the stream to the console
+    outputHeader();
+    outputLine("Streamed Run", 'Y');
+    outputDivider();
+    snprintf(value, sizeof(value), "%lld (%lld late)", stream.arrivals, stream.late);
+    outputVar("Processes: ", 'Y', value);
+    snprintf(value, sizeof(value), "%d (%d slots)", stream.peak, stream.capacity);
+    outputVar("Most live at once: ", 'Y', value);
+    snprintf(value, sizeof(value), "%f", (stream.done > 0) ? stream.total_wait_t / stream.done : 0.0);
+    outputVar("Average wait time: ", 'Y', value);
+    snprintf(value, sizeof(value), "%f", (stream.done > 0) ? stream.total_turnaround_t / stream.done : 0.0);
+    outputVar("Average turnaround time: ", 'Y', value);
+    snprintf(value, sizeof(value), "%ld preemptions, %ld migrations", result->preemptions, result->migrations);
+    outputVar("Moves: ", 'Y', value);
+    snprintf(value, sizeof(value), "%.0f arrivals/s over %fs", stream.arrivals / result->simTime, result->simTime);
+    outputVar("Stream rate: ", 'Y', value);
+    outputPercentileHeader();
+    outputPercentiles("wait", &(result->wait));
+    outputPercentiles("turnaround", &(result->turnaround));
+    outputPercentiles("response", &(result->response));
+    outputPercentiles("decision ns", &(stream.decision));
+    outputPercentileFooter();
+    
+    if(histFilename != NULL)
+    {
+        histExport(result, 1, histFilename);
+    }
+    
+    free(result->cores);
+    free(stream.sim.processes);
+    free(stream.sim.order);
+    free(stream.freeSlots);
+    free(stream.finished);
+    free(buffer);
+    
+    return 0;
+}
+
+/* adds a process of the stream, moving the clock on to its arrival first */
+void streamArrive(Stream_State *stream, const double *fields)
+{
+    Sim_State *sim = &(stream->sim);
+    Process_Params *process;
+    int index = streamSlot(stream);
+    
+    process = &(sim->processes[index]);
+    setProcess(process, fields[0], traceTicks(fields[1], stream->tick, false, stream->input),
+        traceTicks(fields[2], stream->tick, true, stream->input), fields[3],
+        traceTicks(fields[4], stream->tick, true, stream->input));
+    process->remain_t = process->burst_t;
+    process->response_t = -1;
+    sim->order[index] = (uint32_t)stream->arrivals;
+    if(sim->level != NULL)
+    {
+        sim->level[index] = 0;
+    }
+    
+    // The clock cannot go back, so a late process arrives at the time it has reached
+    if(stream->started && process->arrive_t < sim->time)
+    {
+        process->arrive_t = sim->time;
+        stream->late++;
+    }
+    
+    stream->work += process->burst_t;
+    if(process->arrive_t + stream->work > INT_MAX)
+    {
+        printf("%s: stream runs past the largest number of ticks the scheduler can count (%d), "
+            "try a longer tick (-u)\n", stream->input, INT_MAX);
+        exit(-13);
+    }
+    
+    if(!stream->started || process->arrive_t > sim->time)
+    {
+        streamAdvance(stream, process->arrive_t);
+    }
+    simArrive(sim, index, stream->arrivals % sim->numCores);
+    stream->arrivals++;
+    
+    if(++(stream->live) > stream->peak)
+    {
+        stream->peak = stream->live;
+    }
+}
+
+/* runs the stream up to the given time, where the clock stays for the arrivals still to come */
+void streamAdvance(Stream_State *stream, long long time)
+{
+    Sim_State *sim = &(stream->sim);
+    long long next;
+    
+    // Every arrival of the time the clock is at has come, so the cores can be given their work
+    if(stream->started)
+    {
+        simSettle(sim, stream->config);
+    }
+    
+    while((next = simNextTime(sim, stream->config, time)) < time)
+    {
+        sim->time = next;
+        streamStop(stream);
+        simSettle(sim, stream->config);
+    }
+    
+    if(time != LLONG_MAX)
+    {
+        sim->time = time;
+        streamStop(stream);
+        stream->started = true;
+    }
+}
+
+/* takes each process that finishes now for the output and gives back its slot */
+void streamStop(Stream_State *stream)
+{
+    Sim_State *sim = &(stream->sim);
+    Process_Params *process;
+    Completion_Record *finished;
+    int index;
+    
+    while((index = simStop(sim)) >= 0)
+    {
+        process = &(sim->processes[index]);
+        simCompleted(sim, stream->result, index);
+        stream->total_wait_t       += process->wait_t;
+        stream->total_turnaround_t += process->turnaround_t;
+        
+        // Keep the record for after the read, so formatting it does not hold up the decisions
+        if(stream->numFinished == stream->finishedCapacity)
+        {
+            stream->finishedCapacity *= 2;
+            finished = realloc(stream->finished, stream->finishedCapacity * sizeof(Completion_Record));
+            if(finished == NULL)
+            {
+                perror("Error allocating finished processes");
+                exit(-13);
+            }
+            stream->finished = finished;
+        }
+        finished = &(stream->finished[stream->numFinished++]);
+        finished->policy = 0;
+        finished->index = sim->order[index];
+        finished->pid = process->pid;
+        finished->wait_t = process->wait_t;
+        finished->turnaround_t = process->turnaround_t;
+        finished->completion_t = sim->time;
+        
+        stream->work -= process->burst_t;
+        stream->live--;
+        stream->done++;
+        stream->freeSlots[stream->numFree++] = index;
+    }
+}
+
+/* writes the finished processes to the output */
+void streamWrite(Stream_State *stream)
+{
+    Completion_Record *finished;
+    int i;
+    
+    // The arrive and burst times follow from the others
+    for(i = 0; i < stream->numFinished; i++)
+    {
+        finished = &(stream->finished[i]);
+        fprintf(stream->output, "%d,%d,%d,%d,%d,%d\n", finished->pid, finished->completion_t - finished->turnaround_t,
+            finished->turnaround_t - finished->wait_t, finished->wait_t, finished->turnaround_t, finished->completion_t);
+    }
+    stream->numFinished = 0;
+    fflush(stream->output);
+}
+
+/* returns a free process slot, doubling the slots when every one is live */
+int streamSlot(Stream_State *stream)
+{
+    Sim_State *sim = &(stream->sim);
+    Process_Params *processes;
+    uint32_t *order;
+    unsigned char *level = NULL;
+    int *freeSlots;
+    int capacity = stream->capacity * 2, i;
+    
+    if(stream->numFree == 0)
+    {
+        processes = realloc(sim->processes, capacity * sizeof(Process_Params));
+        order = realloc(sim->order, capacity * sizeof(uint32_t));
+        freeSlots = realloc(stream->freeSlots, capacity * sizeof(int));
+        if(sim->level != NULL)
+        {
+            level = realloc(sim->level, capacity * sizeof(unsigned char));
+        }
+        if(processes == NULL || order == NULL || freeSlots == NULL || (sim->level != NULL && level == NULL))
+        {
+            perror("Error allocating process slots");
+            exit(-13);
+        }
+        sim->processes = processes;
+        sim->order = order;
+        sim->level = level;
+        stream->freeSlots = freeSlots;
+        
+        for(i = capacity - 1; i >= stream->capacity; i--)
+        {
+            stream->freeSlots[stream->numFree++] = i;
+        }
+        stream->capacity = capacity;
+    }
+    
+    return stream->freeSlots[--(stream->numFree)];
+}
+
+/* queues a process on a core, which is given it at the end of this time if idle */
+void coreQueue(Sim_State *sim, int core, int index)
+{
+    Core_State *state = &(sim->cores[core]);
+    Heap_Entry *heap;
+    
+    if(state->heapSize == state->heapCapacity)
+    {
+        state->heapCapacity = (state->heapCapacity == 0) ? 64 : state->heapCapacity * 2;
+        heap = realloc(state->heap, state->heapCapacity * sizeof(Heap_Entry));
+        if(heap == NULL)
+        {
+            perror("Error allocating run queue");
+            exit(-1);
+        }
+        state->heap = heap;
+    }
+    
+    heapPush(state->heap, &(state->heapSize), sim->policy->key(sim, index), index, simOrder(sim, index));
+    sim->queued++;
+    
+    if(state->running < 0 && !state->pending)
+    {
+        state->pending = true;
+        sim->pending[sim->numPending++] = core;
+    }
+}
+
+/* gives an idle core the first process of its queue */
+void coreDispatch(Sim_State *sim, int core)
+{
+    Core_State *state = &(sim->cores[core]);
+    
+    state->running = heapPop(state->heap, &(state->heapSize));
+    sim->queued--;
+    sim->idle--;
+    logEvent(sim, EVENT_DISPATCH, core, state->running);
+    if(sim->processes[state->running].response_t < 0)
+    {
+        sim->processes[state->running].response_t = sim->time - sim->processes[state->running].arrive_t;
+    }
+    
+    //A process that used up its slice is only preempted if another one takes over
+    if(state->expired >= 0 && state->expired != state->running)
+    {
+        sim->preemptions++;
+    }
+    state->expired = -1;
+    
+    state->since = sim->time;
+    state->dispatched = sim->time;
+    state->sliceEnd = (sim->policy->slice != NULL) ? (long long)sim->time + sim->policy->slice(sim, state->running) : LLONG_MAX;
+    coreUpdate(sim, core);
+}
+
+/* charges the time the running process has had since it was last charged */
+void coreCharge(Sim_State *sim, int core)
+{
+    Core_State *state = &(sim->cores[core]);
+    
+    sim->processes[state->running].remain_t -= sim->time - state->since;
+    state->busy_t += sim->time - state->since;
+    state->since = sim->time;
+}
+
+/* works out when the core next stops and moves it in the tournament tree */
+void coreUpdate(Sim_State *sim, int core)
+{
+    Core_State *state = &(sim->cores[core]);
+    int node, left, right;
+    
+    state->stop = LLONG_MAX;
+    if(state->running >= 0)
+    {
+        state->stop = (long long)state->since + sim->processes[state->running].remain_t;
+        if(state->sliceEnd < state->stop)
+        {
+            state->stop = state->sliceEnd;
+        }
+    }
+    
+    // Replay the matches on the way up, the earlier stop or else the lower core wins
+    for(node = (sim->leaves + core) / 2; node > 0; node /= 2)
+    {
+        left = sim->tree[2 * node];
+        right = sim->tree[2 * node + 1];
+        sim->tree[node] = (right < 0 || (left >= 0 && sim->cores[left].stop <= sim->cores[right].stop)) ? left : right;
+    }
+}
+
+/* gives every listed core that is idle the first process of its queue */
+void dispatchPending(Sim_State *sim)
+{
+    Core_State *state;
+    int i;
+    
+    for(i = 0; i < sim->numPending; i++)
+    {
+        state = &(sim->cores[sim->pending[i]]);
+        state->pending = false;
+        if(state->running < 0 && state->heapSize > 0)
+        {
+            coreDispatch(sim, sim->pending[i]);
+        }
+    }
+    sim->numPending = 0;
+}
+
+/* moves the first waiting process of one core to another */
+void migrate(Sim_State *sim, int from, int to)
+{
+    int index = heapPop(sim->cores[from].heap, &(sim->cores[from].heapSize));
+    
+    sim->queued--;
+    if((long long)sim->processes[index].remain_t + sim->migrationCost > INT_MAX - sim->time)
+    {
+        printf("Migrations run past the largest time the scheduler can count (%d)\n", INT_MAX);
+        exit(-13);
+    }
+    sim->processes[index].remain_t += sim->migrationCost;
+    sim->cores[to].migrations++;
+    logEvent(sim, EVENT_MIGRATE, to, index);
+    coreQueue(sim, to, index);
+}
+
+/* lets every idle core take a process from the core with the most waiting */
+void stealWork(Sim_State *sim)
+{
+    int i, j, victim, waiting, most;
+    
+    for(i = 0; i < sim->numCores && sim->idle > sim->numPending && sim->queued > 0; i++)
+    {
+        if(sim->cores[i].running >= 0 || sim->cores[i].heapSize > 0)
+        {
+            continue;
+        }
+        
+        // An idle victim keeps the process it is about to be given
+        victim = -1;
+        most = 0;
+        for(j = 0; j < sim->numCores; j++)
+        {
+            waiting = sim->cores[j].heapSize - (sim->cores[j].running < 0 ? 1 : 0);
+            if(waiting > most)
+            {
+                victim = j;
+                most = waiting;
+            }
+        }
+        if(victim < 0)
+        {
+            break;
+        }
+        migrate(sim, victim, i);
+    }
+}
+
+/* moves processes from the busiest to the quietest cores until they differ by at most one */
+void rebalance(Sim_State *sim)
+{
+    int i, busiest, quietest, load, most, least;
+    
+    while(1)
+    {
+        busiest = quietest = 0;
+        most = -1;
+        least = INT_MAX;
+        for(i = 0; i < sim->numCores; i++)
+        {
+            load = sim->cores[i].heapSize + (sim->cores[i].running >= 0 ? 1 : 0);
+            if(load > most)
+            {
+                busiest = i;
+                most = load;
+            }
+            if(load < least)
+            {
+                quietest = i;
+                least = load;
+            }
+        }
+        if(most - least <= 1)
+        {
+            break;
+        }
+        migrate(sim, busiest, quietest);
+    }
+}
+
+/* empties a histogram */
+void histReset(Latency_Histogram *hist)
+{
+    memset(hist, 0, sizeof(Latency_Histogram));
+    hist->min = INT_MAX;
+}
+
+/* counts a time in its bucket */
+void histRecord(Latency_Histogram *hist, int value)
+{
+    if(value < 0)
+    {
+        value = 0;
+    }
+    hist->buckets[histBucket(value)]++;
+    hist->count++;
+    hist->total += value;
+    if(value < hist->min)
+    {
+        hist->min = value;
+    }
+    if(value > hist->max)
+    {
+        hist->max = value;
+    }
+}
+
+/* adds the counts of one histogram to another */
+void histMerge(Latency_Histogram *hist, const Latency_Histogram *other)
+{
+    int i;
+    
+    for(i = 0; i < HIST_BUCKETS; i++)
+    {
+        hist->buckets[i] += other->buckets[i];
+    }
+    hist->count += other->count;
+    hist->total += other->total;
+    if(other->min < hist->min)
+    {
+        hist->min = other->min;
+    }
+    if(other->max > hist->max)
+    {
+        hist->max = other->max;
+    }
+}
+
+/* returns the bucket a time is counted in */
+int histBucket(int value)
+{
+    int shift;
+    
+    if(value < HIST_SUB_COUNT)
+    {
+        return value;
+    }
+    
+    // Shift the time down until it has HIST_SUB_BITS bits, the top one always set
+    shift = 31 - __builtin_clz(value) - (HIST_SUB_BITS - 1);
+    return HIST_SUB_COUNT + (shift - 1) * (HIST_SUB_COUNT / 2) + (value >> shift) - HIST_SUB_COUNT / 2;
+}
+
+/* returns the highest time counted in a bucket */
+int histHighest(int bucket)
+{
+    int shift, top;
+    
+    if(bucket < HIST_SUB_COUNT)
+    {
+        return bucket;
+    }
+    shift = (bucket - HIST_SUB_COUNT) / (HIST_SUB_COUNT / 2) + 1;
+    top = (bucket - HIST_SUB_COUNT) % (HIST_SUB_COUNT / 2) + HIST_SUB_COUNT / 2;
+    return (((long long)top + 1) << shift) - 1;
+}
+
+/* returns the time at or below which a fraction of the counted times are */
+int histPercentile(const Latency_Histogram *hist, double fraction)
+{
+    uint64_t rank = fraction * hist->count, seen = 0;
+    int i;
+    
+    if(hist->count == 0)
+    {
+        return 0;
+    }
+    if(rank < fraction * hist->count || rank == 0)
+    {
+        rank++;
+    }
+    
+    // The bucket holding the rank gives its highest time, but never more than the largest counted
+    for(i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += hist->buckets[i];
+        if(seen >= rank)
+        {
+            break;
+        }
+    }
+    return (histHighest(i) < hist->max) ? histHighest(i) : hist->max;
+}
+
+/* writes the wait, turnaround and response histograms of each policy to a file */
+void histExport(Policy_Result *results, int count, const char *filename)
+{
+    FILE *file = fopen(filename, "wb");
+    char name[HIST_NAME_SIZE];
+    int i;
+    
+    if(file == NULL)
+    {
+        perror(filename);
+        exit(-1);
+    }
+    
+    histWriteHeader(file, 3 * count);
+    for(i = 0; i < count; i++)
+    {
+        snprintf(name, sizeof(name), "%s wait", results[i].policy->name);
+        histWrite(file, name, &(results[i].wait));
+        snprintf(name, sizeof(name), "%s turnaround", results[i].policy->name);
+        histWrite(file, name, &(results[i].turnaround));
+        snprintf(name, sizeof(name), "%s response", results[i].policy->name);
+        histWrite(file, name, &(results[i].response));
+    }
+    
+    if(ferror(file) || fclose(file) != 0)
+    {
+        perror("Error writing histograms");
+        exit(-1);
+    }
+}
+
+/* writes the start of a histogram file */
+void histWriteHeader(FILE *file, uint32_t count)
+{
+    uint32_t subBits = HIST_SUB_BITS;
+    
+    fwrite(HIST_MAGIC, 1, sizeof(HIST_MAGIC) - 1, file);
+    fwrite(&subBits, sizeof(subBits), 1, file);
+    fwrite(&count, sizeof(count), 1, file);
+}
+
+/* writes a histogram with only the buckets it uses */
+void histWrite(FILE *file, const char *name, const Latency_Histogram *hist)
+{
+    char fixedName[HIST_NAME_SIZE];
+    uint32_t used = 0, i;
+    
+    memset(fixedName, 0, sizeof(fixedName));
+    strncpy(fixedName, name, sizeof(fixedName) - 1);
+    for(i = 0; i < HIST_BUCKETS; i++)
+    {
+        used += (hist->buckets[i] > 0);
+    }
+    
+    fwrite(fixedName, 1, sizeof(fixedName), file);
+    fwrite(&(hist->count), sizeof(hist->count), 1, file);
+    fwrite(&(hist->total), sizeof(hist->total), 1, file);
+    fwrite(&(hist->min), sizeof(hist->min), 1, file);
+    fwrite(&(hist->max), sizeof(hist->max), 1, file);
+    fwrite(&used, sizeof(used), 1, file);
+    
+    // Each used bucket as its index and count
+    for(i = 0; i < HIST_BUCKETS; i++)
+    {
+        if(hist->buckets[i] > 0)
+        {
+            fwrite(&i, sizeof(i), 1, file);
+            fwrite(&(hist->buckets[i]), sizeof(hist->buckets[i]), 1, file);
+        }
+    }
+}
+
+/* reads the next histogram of a file, returns false at its end */
+bool histRead(FILE *file, const char *filename, Named_Histogram *named)
+{
+    Latency_Histogram *hist = &(named->hist);
+    uint32_t used, index, i;
+    uint64_t count;
+    
+    if(fread(named->name, 1, sizeof(named->name), file) != sizeof(named->name))
+    {
+        return false;
+    }
+    named->name[sizeof(named->name) - 1] = '\0';
+    
+    histReset(hist);
+    if(fread(&(hist->count), sizeof(hist->count), 1, file) != 1
+        || fread(&(hist->total), sizeof(hist->total), 1, file) != 1
+        || fread(&(hist->min), sizeof(hist->min), 1, file) != 1
+        || fread(&(hist->max), sizeof(hist->max), 1, file) != 1
+        || fread(&used, sizeof(used), 1, file) != 1 || used > HIST_BUCKETS)
+    {
+        printf("%s: histogram %s is cut short\n", filename, named->name);
+        exit(-13);
+    }
+    for(i = 0; i < used; i++)
+    {
+        if(fread(&index, sizeof(index), 1, file) != 1 || fread(&count, sizeof(count), 1, file) != 1
+            || index >= HIST_BUCKETS)
+        {
+            printf("%s: histogram %s is cut short\n", filename, named->name);
+            exit(-13);
+        }
+        hist->buckets[index] = count;
+    }
+    
+    return true;
+}
+
+/* merges the histograms of the same name from several files into one file */
+int runMerge(const char *filename, char **inputs, int numInputs)
+{
+    Named_Histogram *merged = malloc(MAX_HISTOGRAMS * sizeof(Named_Histogram));
+    Named_Histogram *next = malloc(sizeof(Named_Histogram));
+    char magic[sizeof(HIST_MAGIC) - 1];
+    uint32_t subBits, count;
+    FILE *file;
+    int numMerged = 0, i, j;
+    
+    if(merged == NULL || next == NULL)
+    {
+        perror("Error allocating histograms");
+        exit(-1);
+    }
+    if(numInputs == 0)
+    {
+        printf("Missing histogram files to merge\n");
+        return(-12);
+    }
+    
+    for(i = 0; i < numInputs; i++)
+    {
+        file = fopen(inputs[i], "rb");
+        if(file == NULL)
+        {
+            perror(inputs[i]);
+            exit(-13);
+        }
+        if(fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, HIST_MAGIC, sizeof(magic)) != 0
+            || fread(&subBits, sizeof(subBits), 1, file) != 1 || fread(&count, sizeof(count), 1, file) != 1
+            || subBits != HIST_SUB_BITS)
+        {
+            printf("%s: not a histogram file with %d sub-bucket bits\n", inputs[i], HIST_SUB_BITS);
+            exit(-13);
+        }
+        
+        // Add each histogram to the one of the same name, or start it
+        while(histRead(file, inputs[i], next))
+        {
+            for(j = 0; j < numMerged && strcmp(merged[j].name, next->name) != 0; j++);
+            if(j == numMerged)
+            {
+                if(numMerged == MAX_HISTOGRAMS)
+                {
+                    printf("At most %d histograms can be merged\n", MAX_HISTOGRAMS);
+                    exit(-13);
+                }
+                strcpy(merged[j].name, next->name);
+                histReset(&(merged[j].hist));
+                numMerged++;
+            }
+            histMerge(&(merged[j].hist), &(next->hist));
+        }
+        fclose(file);
+    }
+    
+    file = fopen(filename, "wb");
+    if(file == NULL)
+    {
+        perror(filename);
+        exit(-1);
+    }
+    histWriteHeader(file, numMerged);
+    for(j = 0; j < numMerged; j++)
+    {
+        histWrite(file, merged[j].name, &(merged[j].hist));
+    }
+    if(ferror(file) || fclose(file) != 0)
+    {
+        perror("Error writing histograms");
+        exit(-1);
+    }
+    
+    // Output what the merged histograms hold
+    outputWelcome();
+    outputHeader();
+    snprintf(next->name, sizeof(next->name), "%d", numInputs);
+    outputVar("Histogram files merged: ", 'Y', next->name);
+    outputLine("Latency Percentiles", 'Y');
+    outputPercentileHeader();
+    for(j = 0; j < numMerged; j++)
+    {
+        outputPercentiles(merged[j].name, &(merged[j].hist));
+    }
+    outputPercentileFooter();
+    
+    free(merged);
+    free(next);
+    return 0;
+}
+
+/* adds an event to the log, only counting it once the arena is full */
+void logEvent(Sim_State *sim, int type, int core, int index)
+{
+    Event_Log *log = sim->log;
+    Sim_Event *event;
+    
+    if(log == NULL)
+    {
+        return;
+    }
+    if(log->count == log->capacity)
+    {
+        log->dropped++;
+        return;
+    }
+    
+    event = &(log->events[log->count++]);
+    event->time   = sim->time;
+    event->pid    = sim->processes[index].pid;
+    event->core   = core;
+    event->type   = type;
+    event->policy = log->policy;
+}
+
+/* writes the event log as a binary file */
+void writeEventLog(Event_Log *log, const char *filename)
+{
+    FILE *file;
+    uint64_t count = log->count;
+    
+    file = fopen(filename, "wb");
+    if(file == NULL)
+    {
+        perror(filename);
+        exit(-1);
+    }
+    if(fwrite(EVENT_MAGIC, 1, sizeof(EVENT_MAGIC) - 1, file) != sizeof(EVENT_MAGIC) - 1
+        || fwrite(&count, sizeof(count), 1, file) != 1
+        || fwrite(log->events, sizeof(Sim_Event), log->count, file) != (size_t)log->count
+        || fclose(file) != 0)
+    {
+        perror("Error writing event log");
+        exit(-1);
+    }
+}
+
+/* exports the event log as Chrome trace-event JSON */
+void writeChromeTrace(Thread_Params *params, const char *filename)
+{
+    static const char *ends[] = {"dispatched", "preempted", "slice ended", "completed", "migrated"};
+    Event_Log *log = &(params->log);
+    int numCores = params->config.numCores;
+    const char *separator = "\n";
+    Sim_Event *event;
+    FILE *file;
+    int32_t *start;
+    int policy, i;
+    long e;
+    
+    file = fopen(filename, "w");
+    start = malloc(numCores * sizeof(int32_t));
+    if(file == NULL || start == NULL)
+    {
+        perror(filename);
+        exit(-1);
+    }
+    
+    // Name each policy's process and its cores' threads
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for(policy = 0; policy < params->numPolicies; policy++)
+    {
+        fprintf(file, "%s{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}",
+            separator, policy, params->results[policy].policy->name);
+        separator = ",\n";
+        for(i = 0; i < numCores; i++)
+        {
+            fprintf(file, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"CPU %d\"}}",
+                policy, i, i);
+        }
+    }
+    
+    // Each dispatch opens a slice on its core, which the next event there closes
+    for(e = 0; e < log->count; e++)
+    {
+        event = &(log->events[e]);
+        if(event->type == EVENT_DISPATCH)
+        {
+            start[event->core] = event->time;
+        }
+        else if(event->type == EVENT_MIGRATE)
+        {
+            fprintf(file, ",\n{\"name\":\"P%d migrated\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%d,\"pid\":%d,\"tid\":%d}",
+                event->pid, event->time, event->policy, event->core);
+        }
+        else
+        {
+            fprintf(file, ",\n{\"name\":\"P%d\",\"ph\":\"X\",\"ts\":%d,\"dur\":%d,\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"end\":\"%s\"}}", event->pid, start[event->core], event->time - start[event->core],
+                event->policy, event->core, ends[event->type]);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    
+    free(start);
+    if(fclose(file) != 0)
+    {
+        perror("Error writing event trace");
+        exit(-1);
+    }
+}
+
+/* runs every policy again with a thread for each process, comparing it with the simulation */
+void realCompare(Thread_Params *params, long unit)
+{
+    Real_Result real[MAX_POLICIES];
+    Policy_Result *result;
+    uint64_t *arrivals = sortArrivals(params->processes, params->numProcesses);
+    double maxLatency = 0.0;
+    char value[64];
+    int i;
+    
+    for(i = 0; i < params->numPolicies; i++)
+    {
+        runReal(params->processes, params->numProcesses, arrivals, params->results[i].policy,
+            params->config.quantum, unit * 1000LL, &real[i]);
+        if(real[i].max_latency > maxLatency)
+        {
+            maxLatency = real[i].max_latency;
+        }
+    }
+    free(arrivals);
+    
+    outputHeader();
+    snprintf(value, sizeof(value), "Real Execution (average times, %ldus per unit)", unit);
+    outputLine(value, 'Y');
+    
+    printf("╠═══════════╦═════════════╦═════════════╦═══════════╦═══════════╦═════════════╣\n");
+    printf("║ Policy    ║ Sim Wait    ║ Real Wait   ║ Sim Turn  ║ Real Turn ║ Dispatch us ║\n");
+    printf("╠═══════════╬═════════════╬═════════════╬═══════════╬═══════════╬═════════════╣\n");
+    
+    for(i = 0; i < params->numPolicies; i++)
+    {
+        result = &(params->results[i]);
+        printf("║ %-9s ║ %-11f ║ %-11f ║ %-9.3f ║ %-9.3f ║ %-11.1f ║\n", result->policy->name, result->avg_wait_t,
+            real[i].avg_wait_t, result->avg_turnaround_t, real[i].avg_turnaround_t, real[i].avg_latency);
+    }
+    
+    printf("╚═══════════╩═════════════╩═════════════╩═══════════╩═══════════╩═════════════╝\n");
+    
+    outputHeader();
+    for(i = 0; i < params->numPolicies; i++)
+    {
+        if(real[i].preemptions != params->results[i].preemptions)
+        {
+            snprintf(value, sizeof(value), "%ld real, %ld simulated (%s)", real[i].preemptions,
+                params->results[i].preemptions, params->results[i].policy->name);
+            outputVar("Preemptions: ", 'Y', value);
+        }
+    }
+    snprintf(value, sizeof(value), "%.1fus", maxLatency);
+    outputVar("Dispatch latency max: ", 'Y', value);
+    outputFooter();
+}
+
+/* runs one policy with a thread for each process, a time unit being unit ns of CPU work */
+void runReal(Process_Params *processes, int count, const uint64_t *arrivals, const Sched_Policy *policy,
+    int quantum, long long unit, Real_Result *result)
+{
+    Real_State state;
+    Real_Thread *thread;
+    Heap_Entry *heap;
+    pthread_condattr_t condAttr;
+    pthread_attr_t threadAttr;
+    struct timespec deadline;
+    long long now, arrival;
+    double total_wait_t = 0.0, total_turnaround_t = 0.0, turnaround;
+    int heapSize = 0, next = 0, done = 0, running = -1, expired = -1, i;
+    
+    state.threads = calloc(count, sizeof(Real_Thread));
+    heap = malloc(count * sizeof(Heap_Entry));
+    state.sim.processes = processes;
+    state.sim.policy = policy;
+    state.sim.time = 0;
+    state.sim.quantum = quantum;
+    state.sim.sequence = 0;
+    state.sim.level = (policy->expired != NULL) ? calloc(count, sizeof(unsigned char)) : NULL;
+    state.sim.order = NULL;
+    if(state.threads == NULL || heap == NULL || (policy->expired != NULL && state.sim.level == NULL))
+    {
+        perror("Error allocating process threads");
+        exit(-1);
+    }
+    
+    // The dispatcher sleeps on the monotonic clock until the next arrival
+    pthread_mutex_init(&(state.lock), NULL);
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&(state.yielded), &condAttr);
+    pthread_attr_init(&threadAttr);
+    pthread_attr_setstacksize(&threadAttr, REAL_STACK_SIZE);
+    state.unit = unit;
+    state.stopped = -1;
+    state.totalLatency = 0;
+    state.maxLatency = 0;
+    state.dispatches = 0;
+    result->preemptions = 0;
+    
+    for(i = 0; i < count; i++)
+    {
+        processes[i].remain_t = processes[i].burst_t;
+    }
+    
+    pthread_mutex_lock(&(state.lock));
+    state.start = clockNs(CLOCK_MONOTONIC);
+    while(done < count)
+    {
+        now = clockNs(CLOCK_MONOTONIC) - state.start;
+        state.sim.time = now / unit;
+        
+        //Take the CPU back from a thread that stopped, queueing it again unless it is finished
+        if(state.stopped >= 0)
+        {
+            i = state.stopped;
+            thread = &(state.threads[i]);
+            state.stopped = -1;
+            running = -1;
+            if(processes[i].remain_t == 0)
+            {
+                pthread_join(thread->tid, NULL);
+                pthread_cond_destroy(&(thread->go));
+                done++;
+                turnaround = (double)(thread->stopped - state.start) / unit - processes[i].arrive_t;
+                total_turnaround_t += turnaround;
+                total_wait_t += turnaround - processes[i].burst_t;
+            }
+            else
+            {
+                if(thread->expired)
+                {
+                    expired = i;
+                    if(policy->expired != NULL)
+                    {
+                        policy->expired(&(state.sim), i);
+                    }
+                }
+                heapPush(heap, &heapSize, policy->key(&(state.sim), i), i, i);
+            }
+        }
+        
+        //Start a thread for each process that has arrived, telling the running one to stop if the policy says
+        while(next < count && (long long)(arrivals[next] >> 32) * unit <= now)
+        {
+            i = (uint32_t)arrivals[next++];
+            thread = &(state.threads[i]);
+            thread->state = &state;
+            thread->index = i;
+            pthread_cond_init(&(thread->go), NULL);
+            if(pthread_create(&(thread->tid), &threadAttr, realWorker, (void*)thread) != 0)
+            {
+                perror("Error creating process thread");
+                exit(-1);
+            }
+            if(running >= 0 && policy->preempts != NULL && !state.threads[running].stop
+                && policy->preempts(&(state.sim), i, running))
+            {
+                state.threads[running].stop = true;
+                result->preemptions++;
+            }
+            heapPush(heap, &heapSize, policy->key(&(state.sim), i), i, i);
+        }
+        
+        //Give the CPU to the first waiting thread, a thread that used up its slice being preempted if it is not that one
+        if(running < 0 && heapSize > 0)
+        {
+            running = heapPop(heap, &heapSize);
+            if(expired >= 0 && expired != running)
+            {
+                result->preemptions++;
+            }
+            expired = -1;
+            thread = &(state.threads[running]);
+            thread->running = true;
+            thread->stop = false;
+            thread->expired = false;
+            thread->slice = (policy->slice != NULL) ? policy->slice(&(state.sim), running) : 0;
+            thread->resumed = clockNs(CLOCK_MONOTONIC);
+            pthread_cond_signal(&(thread->go));
+        }
+        
+        //Sleep until the thread stops or the next process arrives
+        if(state.stopped < 0 && done < count)
+        {
+            if(next < count)
+            {
+                arrival = state.start + (long long)(arrivals[next] >> 32) * unit;
+                deadline.tv_sec = arrival / 1000000000;
+                deadline.tv_nsec = arrival % 1000000000;
+                pthread_cond_timedwait(&(state.yielded), &(state.lock), &deadline);
+            }
+            else
+            {
+                pthread_cond_wait(&(state.yielded), &(state.lock));
+            }
+        }
+    }
+    pthread_mutex_unlock(&(state.lock));
+    
+    result->avg_wait_t       = total_wait_t / count;
+    result->avg_turnaround_t = total_turnaround_t / count;
+    result->avg_latency      = (state.dispatches > 0) ? state.totalLatency / 1000.0 / state.dispatches : 0.0;
+    result->max_latency      = state.maxLatency / 1000.0;
+    
+    pthread_attr_destroy(&threadAttr);
+    pthread_condattr_destroy(&condAttr);
+    pthread_cond_destroy(&(state.yielded));
+    pthread_mutex_destroy(&(state.lock));
+    free(state.threads);
+    free(state.sim.level);
+    free(heap);
+}
+
+/* this thread is one process, working a unit at a time while the dispatcher lets it */
+void *realWorker(void *thread)
+{
+    Real_Thread *self = (Real_Thread *)(thread);
+    Real_State *state = self->state;
+    Process_Params *process = &(state->sim.processes[self->index]);
+    long long latency;
+    
+    pthread_mutex_lock(&(state->lock));
+    while(process->remain_t > 0)
+    {
+        //Wait to be given the CPU, then note how long it took to get running
+        while(!self->running)
+        {
+            pthread_cond_wait(&(self->go), &(state->lock));
+        }
+        latency = clockNs(CLOCK_MONOTONIC) - self->resumed;
+        state->totalLatency += latency;
+        if(latency > state->maxLatency)
+        {
+            state->maxLatency = latency;
+        }
+        state->dispatches++;
+        
+        //Work a unit at a time, the yield point after each stopping when finished, told to or out of slice
+        do
+        {
+            pthread_mutex_unlock(&(state->lock));
+            realWork(state->unit);
+            pthread_mutex_lock(&(state->lock));
+            process->remain_t--;
+            self->expired = (self->slice > 0 && --self->slice == 0);
+        }
+        while(process->remain_t > 0 && !self->stop && !self->expired);
+        
+        //Hand the CPU back to the dispatcher
+        self->stopped = clockNs(CLOCK_MONOTONIC);
+        self->running = false;
+        state->stopped = self->index;
+        pthread_cond_signal(&(state->yielded));
+    }
+    pthread_mutex_unlock(&(state->lock));
+    
+    return NULL;
+}
+
+/* uses up a time unit of the calling thread's CPU time */
+void realWork(long long unit)
+{
+    volatile uint32_t work = 1;
+    long long end = clockNs(CLOCK_THREAD_CPUTIME_ID) + unit;
+    int i;
+    
+    do
+    {
+        for(i = 0; i < REAL_SPIN; i++)
+        {
+            work = work * 1103515245u + 12345u;
+        }
+    }
+    while(clockNs(CLOCK_THREAD_CPUTIME_ID) < end);
+}
+
+/* returns the time of a clock in ns */
+long long clockNs(clockid_t clock)
+{
+    struct timespec now;
+    
+    clock_gettime(clock, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/* runs every combination of the grid on a pool of workers, writing a CSV row for each */
+int runSweep(Sim_Grid *grid, Thread_Params *params, const char *filename, int workers, const char *histFilename)
+{
+    Sweep_Params sweep;
+    Thread_Params trace;
+    pthread_t threads[MAX_WORKERS];
+    struct timespec start, end;
+    double elapsed;
+    char value[64];
+    int i;
+    
+    outputWelcome();
+    
+    // Load every trace once, the workers share them
+    sweep.grid = grid;
+    sweep.numTraces = (grid->numTraces > 0) ? grid->numTraces : 1;
+    for(i = 0; i < sweep.numTraces; i++)
+    {
+        trace.processes = NULL;
+        trace.numProcesses = 0;
+        trace.capacity = 0;
+        trace.tick = params->tick;
+        loadProcesses(&trace, grid->traces[i]);
+        
+        sweep.traces[i].name = (grid->numTraces > 0) ? grid->traces[i] : "default";
+        sweep.traces[i].processes = trace.processes;
+        sweep.traces[i].numProcesses = trace.numProcesses;
+        sweep.traces[i].arrivals = sortArrivals(trace.processes, trace.numProcesses);
+    }
+    
+    sweep.numPolicies = params->numPolicies;
+    sweep.pooled = (histFilename != NULL) ? params->results : NULL;
+    for(i = 0; i < params->numPolicies; i++)
+    {
+        sweep.policies[i] = params->results[i].policy;
+        histReset(&(params->results[i].wait));
+        histReset(&(params->results[i].turnaround));
+        histReset(&(params->results[i].response));
+    }
+    sweep.numJobs = (long)sweep.numTraces * sweep.numPolicies * grid->numQuanta * grid->numCores
+        * grid->numCosts * grid->numBalances;
+    sweep.nextJob = 0;
+    sweep.runs = 0;
+    
+    sweep.csv = fopen(filename, "w");
+    if(sweep.csv == NULL)
+    {
+        perror("Error opening file");
+        exit(-1);
+    }
+    fprintf(sweep.csv, "trace,policy,quantum,cores,migration_cost,balance,processes,avg_wait,avg_turnaround,"
+        "p50_wait,p90_wait,p99_wait,p999_wait,max_wait,p99_turnaround,p99_response,"
+        "preemptions,migrations,makespan,utilisation,sim_seconds\n");
+    
+    if(pthread_mutex_init(&(sweep.lock), NULL) != 0)
+    {
+        printf("Mutex initialize error\n");
+        return(-10);
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    /* create threads */
+    for(i = 0; i < workers; i++)
+    {
+        if(pthread_create(&threads[i], NULL, sweepWorker, (void*)(&sweep)) != 0)
+        {
+            printf("Sweep thread created error\n");
+            return -1;
+        }
+    }
+    
+    /* wait for threads to exit */
+    for(i = 0; i < workers; i++)
+    {
+        if(pthread_join(threads[i], NULL) != 0)
+        {
+            printf("Join sweep thread error\n");
+            return -3;
+        }
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    
+    pthread_mutex_destroy(&(sweep.lock));
+    fclose(sweep.csv);
+    if(histFilename != NULL)
+    {
+        histExport(params->results, params->numPolicies, histFilename);
+    }
+    for(i = 0; i < sweep.numTraces; i++)
+    {
+        free(sweep.traces[i].processes);
+        free(sweep.traces[i].arrivals);
+    }
+    
+    // Output how the sweep went
+    outputHeader();
+    outputLine("Parameter Sweep", 'Y');
+    outputDivider();
+    snprintf(value, sizeof(value), "%ld of %ld combinations", sweep.runs, sweep.numJobs);
+    outputVar("Runs: ", 'Y', value);
+    snprintf(value, sizeof(value), "%d", workers);
+    outputVar("Workers: ", 'Y', value);
+    snprintf(value, sizeof(value), "%fs", elapsed);
+    outputVar("Sweep time: ", 'Y', value);
+    snprintf(value, sizeof(value), "%.1f", (elapsed > 0) ? sweep.runs / elapsed : 0.0);
+    outputVar("Runs per second: ", 'Y', value);
+    outputVar("Results written to: ", 'Y', (char *)filename);
+    outputFooter();
+    
+    return 0;
+}
+
+/* this thread runs sweep jobs until there are none left */
+void *sweepWorker(void *params)
+{
+    Sweep_Params *sweep = (Sweep_Params *)(params);
+    Sim_Grid *grid = sweep->grid;
+    Sweep_Trace *trace;
+    Process_Params *processes = NULL;
+    Policy_Result result;
+    Sim_Config config;
+    char row[SWEEP_ROW_SIZE], balance[32], quantum[16];
+    long job, busy;
+    int capacity = 0, quantumIndex, coreIndex, costIndex, balanceIndex, policyIndex, i;
+    
+    result.cores = NULL;
+    
+    while(1)
+    {
+        pthread_mutex_lock(&(sweep->lock));
+        job = sweep->nextJob++;
+        pthread_mutex_unlock(&(sweep->lock));
+        if(job >= sweep->numJobs)
+        {
+            break;
+        }
+        
+        // The balancing changes fastest and the trace slowest, so workers tend to share a trace
+        balanceIndex = job % grid->numBalances;
+        job /= grid->numBalances;
+        costIndex = job % grid->numCosts;
+        job /= grid->numCosts;
+        coreIndex = job % grid->numCores;
+        job /= grid->numCores;
+        quantumIndex = job % grid->numQuanta;
+        job /= grid->numQuanta;
+        policyIndex = job % sweep->numPolicies;
+        result.policy = sweep->policies[policyIndex];
+        trace = &(sweep->traces[job / sweep->numPolicies]);
+        
+        // Skip settings that would not change the run
+        if((result.policy->slice == NULL && quantumIndex > 0)
+            || (grid->cores[coreIndex] == 1 && (costIndex > 0 || balanceIndex > 0)))
+        {
+            continue;
+        }
+        config.quantum = grid->quanta[quantumIndex];
+        config.numCores = grid->cores[coreIndex];
+        config.migrationCost = grid->costs[costIndex];
+        config.balance = grid->balances[balanceIndex];
+        config.interval = grid->intervals[balanceIndex];
+        
+        // Run on this worker's own copy of the process table
+        if(trace->numProcesses > capacity)
+        {
+            capacity = trace->numProcesses;
+            free(processes);
+            processes = malloc(capacity * sizeof(Process_Params));
+            if(processes == NULL)
+            {
+                perror("Error allocating process table");
+                exit(-1);
+            }
+        }
+        memcpy(processes, trace->processes, trace->numProcesses * sizeof(Process_Params));
+        runPolicy(processes, trace->numProcesses, trace->arrivals, &config, &result, NULL, NULL);
+        
+        for(i = 0, busy = 0; i < config.numCores; i++)
+        {
+            busy += result.cores[i].busy_t;
+        }
+        if(config.balance == BALANCE_REBALANCE)
+        {
+            snprintf(balance, sizeof(balance), "rebalance:%d", config.interval);
+        }
+        else
+        {
+            snprintf(balance, sizeof(balance), "%s", (config.balance == BALANCE_STEAL) ? "steal" : "none");
+        }
+        quantum[0] = '\0';
+        if(result.policy->slice != NULL)
+        {
+            snprintf(quantum, sizeof(quantum), "%d", config.quantum);
+        }
+        snprintf(row, sizeof(row), "%s,%s,%s,%d,%d,%s,%d,%f,%f,%d,%d,%d,%d,%d,%d,%d,%ld,%ld,%d,%f,%f\n",
+            trace->name, result.policy->name, quantum, config.numCores, config.migrationCost, balance,
+            trace->numProcesses, result.avg_wait_t, result.avg_turnaround_t, histPercentile(&(result.wait), 0.5),
+            histPercentile(&(result.wait), 0.9), result.p99_wait_t, histPercentile(&(result.wait), 0.999),
+            result.max_wait_t, histPercentile(&(result.turnaround), 0.99), histPercentile(&(result.response), 0.99),
+            result.preemptions, result.migrations, result.makespan,
+            (result.makespan > 0) ? (double)busy / ((double)config.numCores * result.makespan) : 0.0, result.simTime);
+        
+        // Stream the row out as soon as it is ready
+        pthread_mutex_lock(&(sweep->lock));
+        fputs(row, sweep->csv);
+        fflush(sweep->csv);
+        sweep->runs++;
+        if(sweep->pooled != NULL)
+        {
+            histMerge(&(sweep->pooled[policyIndex].wait), &(result.wait));
+            histMerge(&(sweep->pooled[policyIndex].turnaround), &(result.turnaround));
+            histMerge(&(sweep->pooled[policyIndex].response), &(result.response));
+        }
+        pthread_mutex_unlock(&(sweep->lock));
+    }
+    
+    free(processes);
+    free(result.cores);
+    
+    pthread_exit(NULL);
+}
+
+/* adds a process with its key to the ready heap */
+void heapPush(Heap_Entry *heap, int *size, uint64_t key, int index, uint32_t order)
+{
+    int i = (*size)++, parent;
+    
+    // Move the entry up past every parent that runs after it
+    while(i > 0)
+    {
+        parent = (i - 1) / 2;
+        if(heap[parent].key < key || (heap[parent].key == key && heap[parent].order < order))
+        {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i].key = key;
+    heap[i].index = index;
+    heap[i].order = order;
+}
+
+/* removes the process with the smallest key from the ready heap */
+int heapPop(Heap_Entry *heap, int *size)
+{
+    int top = heap[0].index;
+    Heap_Entry last = heap[--(*size)];
+    int i = 0, child;
+    
+    // Move the last entry down from the root past every child that runs before it
+    while((child = 2 * i + 1) < *size)
+    {
+        if(child + 1 < *size && (heap[child + 1].key < heap[child].key
+            || (heap[child + 1].key == heap[child].key && heap[child + 1].order < heap[child].order)))
+        {
+            child++;
+        }
+        if(last.key < heap[child].key || (last.key == heap[child].key && last.order < heap[child].order))
+        {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    
+    return top;
+}
+
+/* copies the fields a scan reads into columns */
+void columnsLoad(Process_Columns *columns, const Process_Params *processes, int count)
+{
+    // Whole cache lines, so the vector loads of a column never share one with anything else
+    size_t size = ((size_t)count * sizeof(int32_t) + 63) & ~(size_t)63;
+    int i;
+    
+    columns->arrive_t = aligned_alloc(64, size);
+    columns->remain_t = aligned_alloc(64, size);
+    columns->count = count;
+    if(columns->arrive_t == NULL || columns->remain_t == NULL)
+    {
+        perror("Error allocating process columns");
+        exit(-1);
+    }
+    
+    for(i = 0; i < count; i++)
+    {
+        columns->arrive_t[i] = processes[i].arrive_t;
+        columns->remain_t[i] = processes[i].remain_t;
+    }
+}
+
+/* frees the columns */
+void columnsFree(Process_Columns *columns)
+{
+    free(columns->arrive_t);
+    free(columns->remain_t);
+}
+
+/* scans the process table, as the tick-by-tick scheduler did each tick */
+int scanMinTable(const Process_Params *processes, int count, int time)
+{
+    int best = -1, bestRemain = INT_MAX, i;
+    
+    for(i = 0; i < count; i++)
+    {
+        if(processes[i].arrive_t <= time && processes[i].remain_t > 0 && processes[i].remain_t < bestRemain)
+        {
+            best = i;
+            bestRemain = processes[i].remain_t;
+        }
+    }
+    return best;
+}
+
+/* scans the columns a process at a time */
+int scanMinColumns(const Process_Columns *columns, int time)
+{
+    int best = -1, bestRemain = INT_MAX, i;
+    
+    for(i = 0; i < columns->count; i++)
+    {
+        if(columns->arrive_t[i] <= time && columns->remain_t[i] > 0 && columns->remain_t[i] < bestRemain)
+        {
+            best = i;
+            bestRemain = columns->remain_t[i];
+        }
+    }
+    return best;
+}
+
+#ifdef __x86_64__
+/* scans the columns eight processes at a time, each lane keeping its own best */
+__attribute__((target("avx2")))
+int scanMinAVX2(const Process_Columns *columns, int time)
+{
+    __m256i now = _mm256_set1_epi32(time), zero = _mm256_setzero_si256();
+    __m256i best = _mm256_set1_epi32(INT_MAX), bestIndex = _mm256_set1_epi32(-1);
+    __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), step = _mm256_set1_epi32(8);
+    __m256i arrive, remain, less;
+    int32_t lanes[8], laneIndex[8];
+    int found = -1, foundRemain = INT_MAX, i;
+    
+    for(i = 0; i + 8 <= columns->count; i += 8)
+    {
+        arrive = _mm256_loadu_si256((const __m256i *)(columns->arrive_t + i));
+        remain = _mm256_loadu_si256((const __m256i *)(columns->remain_t + i));
+        
+        // Arrived, unfinished and strictly less, so a lane keeps the first of equal times
+        less = _mm256_andnot_si256(_mm256_cmpgt_epi32(arrive, now),
+            _mm256_and_si256(_mm256_cmpgt_epi32(remain, zero), _mm256_cmpgt_epi32(best, remain)));
+        best = _mm256_blendv_epi8(best, remain, less);
+        bestIndex = _mm256_blendv_epi8(bestIndex, index, less);
+        index = _mm256_add_epi32(index, step);
+    }
+    
+    // The lanes' bests, then the processes left over, the first listed winning a tie
+    _mm256_storeu_si256((__m256i *)lanes, best);
+    _mm256_storeu_si256((__m256i *)laneIndex, bestIndex);
+    for(i = 0; i < 8; i++)
+    {
+        if(laneIndex[i] >= 0 && (lanes[i] < foundRemain || (lanes[i] == foundRemain && laneIndex[i] < found)))
+        {
+            found = laneIndex[i];
+            foundRemain = lanes[i];
+        }
+    }
+    for(i = columns->count & ~7; i < columns->count; i++)
+    {
+        if(columns->arrive_t[i] <= time && columns->remain_t[i] > 0 && columns->remain_t[i] < foundRemain)
+        {
+            found = i;
+            foundRemain = columns->remain_t[i];
+        }
+    }
+    return found;
+}
+
+/* scans the columns sixteen processes at a time, masking off those past the end */
+__attribute__((target("avx512f")))
+int scanMinAVX512(const Process_Columns *columns, int time)
+{
+    __m512i now = _mm512_set1_epi32(time), zero = _mm512_setzero_si512();
+    __m512i best = _mm512_set1_epi32(INT_MAX), bestIndex = _mm512_set1_epi32(-1);
+    __m512i index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m512i step = _mm512_set1_epi32(16), arrive, remain;
+    __mmask16 valid = 0xFFFF, less;
+    int32_t lanes[16], laneIndex[16];
+    int found = -1, foundRemain = INT_MAX, i;
+    
+    for(i = 0; i < columns->count; i += 16)
+    {
+        if(columns->count - i < 16)
+        {
+            valid = (1u << (columns->count - i)) - 1;
+        }
+        arrive = _mm512_maskz_loadu_epi32(valid, columns->arrive_t + i);
+        remain = _mm512_maskz_loadu_epi32(valid, columns->remain_t + i);
+        
+        // Arrived, unfinished and strictly less, so a lane keeps the first of equal times
+        less = _mm512_mask_cmple_epi32_mask(valid, arrive, now);
+        less = _mm512_mask_cmpgt_epi32_mask(less, remain, zero);
+        less = _mm512_mask_cmplt_epi32_mask(less, remain, best);
+        best = _mm512_mask_mov_epi32(best, less, remain);
+        bestIndex = _mm512_mask_mov_epi32(bestIndex, less, index);
+        index = _mm512_add_epi32(index, step);
+    }
+    
+    _mm512_storeu_si512(lanes, best);
+    _mm512_storeu_si512(laneIndex, bestIndex);
+    for(i = 0; i < 16; i++)
+    {
+        if(laneIndex[i] >= 0 && (lanes[i] < foundRemain || (lanes[i] == foundRemain && laneIndex[i] < found)))
+        {
+            found = laneIndex[i];
+            foundRemain = lanes[i];
+        }
+    }
+    return found;
+}
+#endif
+
+/* times the scans over growing numbers of processes */
+int runBenchmark()
+{
+    static const char *names[] = {"table", "columns", "AVX2", "AVX-512"};
+    Scan_Kernel kernels[4] = {NULL, scanMinColumns, NULL, NULL};
+    Process_Params *processes;
+    Process_Columns columns;
+    struct timespec start, end;
+    double ns[4], fastest;
+    char value[4][16];
+    uint32_t seed = 1;
+    long reps, r;
+    int count, found[4], k, i;
+    
+#ifdef __x86_64__
+    kernels[2] = __builtin_cpu_supports("avx2") ? scanMinAVX2 : NULL;
+    kernels[3] = __builtin_cpu_supports("avx512f") ? scanMinAVX512 : NULL;
+#endif
+    
+    processes = malloc((size_t)SCAN_MAX_PROCESSES * sizeof(Process_Params));
+    if(processes == NULL)
+    {
+        perror("Error allocating process table");
+        exit(-1);
+    }
+    
+    outputWelcome();
+    outputHeader();
+    outputLine("Least Remaining Time Scan (ns per process)", 'Y');
+    printf("╠═══════════╦═══════════╦═══════════╦═══════════╦════════════╦════════════════╣\n");
+    printf("║ Processes ║ Table     ║ Columns   ║ AVX2      ║ AVX-512    ║ Speedup        ║\n");
+    printf("╠═══════════╬═══════════╬═══════════╬═══════════╬════════════╬════════════════╣\n");
+    
+    for(count = SCAN_MIN_PROCESSES; count <= SCAN_MAX_PROCESSES; count *= 10)
+    {
+        // Processes arrive over the span of the scans' times, an eighth of them finished
+        for(i = 0; i < count; i++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            processes[i].pid = i + 1;
+            processes[i].arrive_t = (seed >> 8) % count;
+            processes[i].remain_t = ((seed >> 4) % 8 == 0) ? 0 : 1 + (seed >> 12) % 1000;
+        }
+        columnsLoad(&columns, processes, count);
+        reps = (SCAN_WORK / count > 3) ? SCAN_WORK / count : 3;
+        
+        for(k = 0; k < 4; k++)
+        {
+            ns[k] = 0.0;
+            found[k] = 0;
+            if(k > 0 && kernels[k] == NULL)
+            {
+                continue;
+            }
+            
+            // Each rep scans at a different time, so no two scans are the same
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for(r = 0; r < reps; r++)
+            {
+                found[k] += (k == 0) ? scanMinTable(processes, count, r % count)
+                    : kernels[k](&columns, r % count);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            ns[k] = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / ((double)reps * count);
+            
+            if(found[k] != found[0])
+            {
+                printf("Scan over the %s found other processes than over the table\n", names[k]);
+                exit(-1);
+            }
+        }
+        columnsFree(&columns);
+        
+        fastest = ns[0];
+        for(k = 0; k < 4; k++)
+        {
+            if(ns[k] > 0.0 && ns[k] < fastest)
+            {
+                fastest = ns[k];
+            }
+            if(k > 0 && kernels[k] == NULL)
+            {
+                snprintf(value[k], sizeof(value[k]), "-");
+            }
+            else
+            {
+                snprintf(value[k], sizeof(value[k]), "%.3f", ns[k]);
+            }
+        }
+        printf("║ %-9d ║ %-9s ║ %-9s ║ %-9s ║ %-10s ║ %-14.1f ║\n", count, value[0], value[1], value[2], value[3],
+            ns[0] / fastest);
+    }
+    
+    printf("╚═══════════╩═══════════╩═══════════╩═══════════╩════════════╩════════════════╝\n");
+    free(processes);
+    
+    return 0;
+}
+
+/* orders by remaining time */
+uint64_t srtfKey(Sim_State *sim, int index)
+{
+    return sim->processes[index].remain_t;
+}
+
+/* orders by arrive time */
+uint64_t fcfsKey(Sim_State *sim, int index)
+{
+    return sim->processes[index].arrive_t;
+}
+
+/* orders by burst time */
+uint64_t sjfKey(Sim_State *sim, int index)
+{
+    return sim->processes[index].burst_t;
+}
+
+/* orders by when the process was queued */
+uint64_t rrKey(Sim_State *sim, int index)
+{
+    return sim->sequence++;
+}
+
+/* orders by priority less one for every AGING_INTERVAL waited. Every waiting process ages at
+ * the same rate, so their order is fixed by priority * AGING_INTERVAL + time queued */
+uint64_t priorityKey(Sim_State *sim, int index)
+{
+    return (uint64_t)sim->processes[index].priority * AGING_INTERVAL + sim->time;
+}
+
+/* orders by queue level, then by when the process was queued */
+uint64_t mlfqKey(Sim_State *sim, int index)
+{
+    return ((uint64_t)sim->level[index] << 48) | sim->sequence++;
+}
+
+/* orders by deadline, taking the end of an unbroken run for a process without one */
+uint64_t edfKey(Sim_State *sim, int index)
+{
+    if(sim->processes[index].deadline_t < 0)
+    {
+        return (uint64_t)sim->processes[index].arrive_t + sim->processes[index].burst_t;
+    }
+    return sim->processes[index].deadline_t;
+}
+
+/* preempts with less remaining time */
+bool srtfPreempts(Sim_State *sim, int arrival, int running)
+{
+    return sim->processes[arrival].remain_t < sim->processes[running].remain_t
+        || (sim->processes[arrival].remain_t == sim->processes[running].remain_t
+            && simOrder(sim, arrival) < simOrder(sim, running));
+}
+
+/* preempts a process that has dropped below the top queue */
+bool mlfqPreempts(Sim_State *sim, int arrival, int running)
+{
+    return sim->level[arrival] < sim->level[running];
+}
+
+/* preempts with an earlier deadline */
+bool edfPreempts(Sim_State *sim, int arrival, int running)
+{
+    return edfKey(sim, arrival) < edfKey(sim, running)
+        || (edfKey(sim, arrival) == edfKey(sim, running) && simOrder(sim, arrival) < simOrder(sim, running));
+}
+
+/* the same slice for everyone */
+int rrSlice(Sim_State *sim, int index)
+{
+    return sim->quantum;
+}
+
+/* a slice twice as long at each level down */
+int mlfqSlice(Sim_State *sim, int index)
+{
+    return sim->quantum << sim->level[index];
+}
+
+/* drops the process a level, the bottom queue is round-robin */
+void mlfqExpired(Sim_State *sim, int index)
+{
+    if(sim->level[index] < MLFQ_LEVELS - 1)
+    {
+        sim->level[index]++;
+    }
+}
+
+/* Outputs the welcome banner to the console */
+void outputWelcome()
+{
+    printf("\x1B[33m");
+    printf("                                             _______________________\n");
+    printf("   _______________________-------------------                       `\\\n");
+    printf(" /:--__                                                              |\n");
+    printf("||< > |                                   ___________________________/\n");
+    printf("| \\__/_________________-------------------                         |\n");
+    printf("|                                                                  |\n");
+    printf(" |                                                                  |\n");
+    printf(" |                      THE SUPER CPU SCHEDULER                     |\n");
+    printf(" |                                                                  |\n");
+    printf("  |                         CPU Scheduling,                          |\n");
+    printf("  |                              FIFOs,                              |\n");
+    printf("  |                        Memory Managment,                         |\n");
+    printf("  |                           And Signals                             |\n");
+    printf("   |                                                                  |\n");
+    printf("   |                       By Jack Romanous                           |\n");
+    printf("   |                          (12551519)                             |\n");
+    printf("  |                                              ____________________|_\n");
+    printf("  |  ___________________-------------------------                      `\\\n");
+    printf("  |/`--_                                                                 |\n");
+    printf("  ||[ ]||                                            ___________________/\n");
+    printf("   \\===/___________________--------------------------\n\n");
+    printf("\x1B[0m");
+}
+
+/* Outputs the header line to the console */
+void outputHeader()
+{
+    printf("╔═════════════════════════════════════════════════════════════════════════════╗\n");
+}
+
+/* Outputs the dividing line to the console */
+void outputDivider()
+{
+    printf("╠═════════════════════════════════════════════════════════════════════════════╣\n");
+}
+
+/* Outputs the footer line to the console */
+void outputFooter()
+{
+    printf("╚═════════════════════════════════════════════════════════════════════════════╝\n");
+}
+
+/* Outputs the percentile table header to the console */
+void outputPercentileHeader()
+{
+    printf("╠══════════════════════╦═════════╦═════════╦═════════╦═════════╦══════════════╣\n");
+    printf("║ Histogram            ║ p50     ║ p90     ║ p99     ║ p99.9   ║ Max          ║\n");
+    printf("╠══════════════════════╬═════════╬═════════╬═════════╬═════════╬══════════════╣\n");
+}
+
+/* Outputs the percentiles of a histogram as a table row to the console */
+void outputPercentiles(const char *name, const Latency_Histogram *hist)
+{
+    printf("║ %-20s ║ %-7d ║ %-7d ║ %-7d ║ %-7d ║ %-12d ║\n", name, histPercentile(hist, 0.5),
+        histPercentile(hist, 0.9), histPercentile(hist, 0.99), histPercentile(hist, 0.999), hist->max);
+}
+
+/* Outputs the percentile table footer to the console */
+void outputPercentileFooter()
+{
+    printf("╚══════════════════════╩═════════╩═════════╩═════════╩═════════╩══════════════╝\n");
+}
+
+/* Outputs a message line to the console */
+void outputLine(char *message, const char color)
+{
+    printf("║ ");
+    changeColor(color);
+    printf("%s", message);
+    
+    printf("\x1B[0m");
+    
+    for(int i = 0; i < (75 - strlen(message)); i++)
+    {
+        printf(" ");
+    }
+    printf(" ║\n");
+}
+
+/* Outputs a message with variable line to the console */
+void outputVar(char *message, const char color, char *value)
+{
+    int valLength = 0;
+    
+    printf("║ ");
+    changeColor(color);
+    printf("%s", message);
+    
+    for(int i = 0; i < strlen(value); i++)
+    {
+        if(value[i] != '\n' && value[i] != '\r' )
+        {
+            printf("%c", value[i]);
+            valLength++;
+        }
+    }
+    
+    printf("\x1B[0m");
+    
+    for(int i = 0; i < (75 - strlen(message) - valLength); i++)
+    {
+        printf(" ");
+    }
+    printf(" ║\n");
+}
+
+/* Changes the console color */
+void changeColor(const char color)
+{
+    switch(color)
+    {
+        case 'R':
+            printf("\x1B[31m");
+            break;
+        case 'G':
+            printf("\x1B[32m");
+            break;
+        case 'Y':
+            printf("\x1B[33m");
+            break;
+        case 'B':
+            printf("\x1B[34m");
+            break;
+        case 'M':
+            printf("\x1b[35m");
+            break;
+        case 'C':
+            printf("\x1b[36m");
+            break;
+    }
 }
\ No newline at end of file
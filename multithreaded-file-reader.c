@@ -1,482 +1,4723 @@
-/*******************************************************************************
- * 
- * Project: The Super File Reader
- * 
- * Authors:
- * Jack Romanous
- * Braden Payne
- * 
- * Compile instructions:
- * Ensure gcc is installed then run the following command:
- * gcc multithreaded-file-reader.c -o multithreaded-file-reader -lpthread -lrt
- * 
- * Notes:
- * Toggle DEBUG mode on (1) or off (0) for more information on line 38
- * 
- ******************************************************************************/
-
-/* --- Included Libraries --- */
-
-#include <pthread.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <stdio.h>
-#include <sys/types.h>
-#include <fcntl.h>
-#include <string.h>
-#include <sys/stat.h>
-#include <semaphore.h>
-#include <sys/time.h>
-
-/* --- Constant Definitions --- */
-
-#define MAX_LINE_SIZE 255
-#define END_HEADER "end_header"
-#define DEBUG 1
-
-/* --- Structs --- */
-
-typedef struct ThreadParams
-{
-    int pipeFile[2];
-    sem_t sem_A_to_B, sem_B_to_C, sem_C_to_A;
-    char message[MAX_LINE_SIZE];
-    char readFilename[MAX_LINE_SIZE];
-    char writeFilename[MAX_LINE_SIZE];
-    int reachedEnd;
-} ThreadParams;
-
-/* --- Prototypes --- */
-
-/* Initializes data and utilities used in thread params */
-void initializeData(ThreadParams *params);
-
-/* This thread reads data from a file and writes each line to a pipe */
-void *ThreadA(void *params);
-
-/* This thread reads data from pipe used in ThreadA and writes it to a shared variable */
-void *ThreadB(void *params);
-
-/* This thread reads from shared variable and outputs non-header to a file */
-void *ThreadC(void *params);
-
-/* Outputs the welcome banner to the console */
-void outputWelcome();
-
-/* Outputs the header line to the console */
-void outputHeader();
-
-/* Outputs the dividing line to the console */
-void outputDivider();
-
-/* Outputs the footer line to the console */
-void outputFooter();
-
-/* Outputs a message line to the console */
-void outputLine(char *message, const char color);
-
-/* Outputs a message with variable line to the console */
-void outputVar(char *message, const char color, char *value);
-
-/* Inputs a filename from the user */
-void inputFilename(FILE **file, char *filename, char *permission, char *purpose);
-
-/* Changes the console color */
-void changeColor(const char color);
-
-/* --- Main Code --- */
-int main(int argc, char const *argv[])
-{
-    // Initialise variables
-    int result;
-    pthread_t tid1, tid2, tid3;
-    pthread_attr_t attr;
-    ThreadParams params;
-    
-    // Output banner to the console
-    outputWelcome();
-    
-    // Initialise semaphores
-    initializeData(&params);
-    pthread_attr_init(&attr);
-    
-    // Create pipe
-    result = pipe(params.pipeFile);
-    if(result < 0)
-    {
-        perror("Error creating pipe");
-        exit(1);
-    }
-    
-    // Create threads
-    if(pthread_create(&tid1, &attr, ThreadA, (void*)(&params))!=0)
-    {
-        perror("Error creating threads: ");
-        exit(-1);
-    }
-    
-    if(pthread_create(&tid2, &attr, ThreadB, (void*)(&params))!=0)
-    {
-        perror("Error creating threads: ");
-        exit(-1);
-    }
-    
-    if(pthread_create(&tid3, &attr, ThreadC, (void*)(&params))!=0)
-    {
-        perror("Error creating threads: ");
-        exit(-1);
-    }
-    
-    // Wait on threads to finish
-    pthread_join(tid1, NULL);
-    pthread_join(tid2, NULL);
-    pthread_join(tid3, NULL);
-    
-    return 0;
-}
-
-/* Initializes data and utilities used in thread params */
-void initializeData(ThreadParams *params) 
-{
-    if(sem_init(&(params->sem_A_to_B), 0, 1))
-    {
-        perror("Error initializing sem_A_to_B semaphore");
-        exit(0);
-    }
-    
-    if(sem_init(&(params->sem_B_to_C), 0, 0))
-    {
-        perror("Error initializing sem_B_to_C semaphore");
-        exit(0);
-    }
-    
-    if(sem_init(&(params->sem_C_to_A), 0, 0))
-    {
-        perror("Error initializing sem_C_to_A semaphore");
-        exit(0);
-    }
-    
-    return;
-}
-
-/* This thread reads data from a file and writes each line to a pipe */
-void *ThreadA(void *params) 
-{
-    // Initialise variables
-    ThreadParams *A_thread_params = (ThreadParams *)(params);
-    int result;
-    char txtLine[MAX_LINE_SIZE];
-    FILE* readTxt;
-    
-    // Get name of input file from user
-    sem_wait(&(A_thread_params->sem_A_to_B));
-    inputFilename(&readTxt,A_thread_params->readFilename,"r","import");
-    sem_post(&(A_thread_params->sem_B_to_C));
-    
-    // Read all lines from input file
-    while(fgets(txtLine, sizeof(txtLine), readTxt) != NULL)
-    {
-        // Wait for access to thread
-        sem_wait(&(A_thread_params->sem_A_to_B));
-        
-        // Write line to pipe
-        result = write(A_thread_params->pipeFile[1], txtLine, MAX_LINE_SIZE);
-        if(result < 0)
-        { 
-            perror("Error writing to pipe");  
-            exit(2);
-        }
-        
-        if(DEBUG)
-        {
-            outputVar("THREADA: Output line to pipe: ", 'M', txtLine);
-        }
-        
-        // Give access to thread
-        sem_post(&(A_thread_params->sem_B_to_C));
-    }
-    
-    // Wait for access to thread
-    sem_wait(&(A_thread_params->sem_A_to_B));
-    
-    // Close file and stop reading from it
-    A_thread_params->reachedEnd = 1;
-    fclose(readTxt);
-    
-    if(DEBUG)
-    {
-        outputLine("SUCCESS: Closed input file", 'Y');
-    }
-    
-    // Give access to thread
-    sem_post(&(A_thread_params->sem_B_to_C));
-}
-
-/* This thread reads data from pipe used in ThreadA and writes it to a shared variable */
-void *ThreadB(void *params) 
-{
-    // Initialise variables
-    ThreadParams *B_thread_params = (ThreadParams *)(params);
-    int result;
-    
-    // Thread B has no file to initialise so move to C
-    sem_wait(&(B_thread_params->sem_B_to_C));
-    sem_post(&(B_thread_params->sem_C_to_A));
-    
-    // Wait for access to thread
-    while(!sem_wait(&(B_thread_params->sem_B_to_C)))
-    {
-        // Check if file has finished reading
-        if(B_thread_params->reachedEnd == 1)
-        {
-            break;
-        }
-        
-        // Read from pipe
-        result = read(B_thread_params->pipeFile[0],B_thread_params->message,MAX_LINE_SIZE);
-        if(result <= 0)
-        {
-            perror("Error reading from pipe");
-            exit(4);
-        }
-        
-        if(DEBUG)
-        {
-            outputVar("THREADB: Read line from pipe: ", 'B', B_thread_params->message);
-        }
-        
-        // Give access to thread
-        sem_post(&(B_thread_params->sem_C_to_A));
-    }
-    
-    // Give access to thread
-    sem_post(&(B_thread_params->sem_C_to_A));
-}
-
-/* This thread reads from shared variable and outputs non-header to a file */
-void *ThreadC(void *params) 
-{
-    // Initialise variables
-    ThreadParams *C_thread_params = (ThreadParams *)(params);
-    int headerflag = 0;
-    FILE* writeTxt;
-    
-    // Get name of output file from user
-    sem_wait(&(C_thread_params->sem_C_to_A));
-    inputFilename(&writeTxt,C_thread_params->writeFilename,"w","output");
-    outputHeader();
-    outputLine("SUCCESS: Program started transferring data", 'Y');
-    outputDivider();
-    sem_post(&(C_thread_params->sem_A_to_B));
-    
-    // Wait for access to thread
-    while(!sem_wait(&(C_thread_params->sem_C_to_A)))
-    {
-        // Check if file has finished reading
-        if(C_thread_params->reachedEnd == 1)
-        {
-            break;
-        }
-        // Check if end of header has been reached
-        else if(headerflag == 1)
-        {
-            fputs(C_thread_params->message, writeTxt);
-            
-            if(DEBUG)
-            {
-                outputVar("THREADC: Output line to file: ", 'G', C_thread_params->message);
-            }
-        }
-        // Check if current line to the end header flag
-        else if(strstr(C_thread_params->message, END_HEADER) != NULL)
-        {
-            headerflag = 1;
-            
-            if(DEBUG)
-            {
-                outputVar("THREADC: Reached header flag: ", 'C', C_thread_params->message);
-            }
-        }
-        // Otherwise ignore header line
-        else
-        {
-            if(DEBUG)
-            {
-                outputVar("THREADC: Skipped header line: ", 'R', C_thread_params->message);
-            }
-        }
-        
-        if(DEBUG)
-        {
-            outputDivider();
-        }
-        
-        // Give access to thread
-        sem_post(&(C_thread_params->sem_A_to_B));
-    }
-    
-    // Close file
-    fclose(writeTxt);
-    
-    if(DEBUG)
-    {
-        outputLine("SUCCESS: Closed output file", 'Y');
-    }
-    
-    // Output completion message
-    outputVar("SUCCESS: Read all data from ", 'Y', C_thread_params->readFilename);
-    outputVar("SUCCESS: Output all data to ", 'Y', C_thread_params->writeFilename);
-    outputFooter();
-}
-
-/* Outputs the welcome banner to the console */
-void outputWelcome()
-{
-    printf("\x1B[33m");
-    printf("                                             _______________________\n");
-    printf("   _______________________-------------------                       `\\\n");
-    printf(" /:--__                                                              |\n");
-    printf("||< > |                                   ___________________________/\n");
-    printf("| \\__/_________________-------------------                         |\n");
-    printf("|                                                                  |\n");
-    printf(" |                                                                  |\n");
-    printf(" |                       THE SUPER FILE READER                      |\n");
-    printf(" |                                                                  |\n");
-    printf("  |                         Read from files,                         |\n");
-    printf("  |                          Write to files,                         |\n");
-    printf("  |                          Multithreaded,                          |\n");
-    printf("  |                  And so many more great features                  |\n");
-    printf("   |                                                                  |\n");
-    printf("   |                 By Braden Payne and Jack Romanous                |\n");
-    printf("   |                     (12947697)        (12551519)                |\n");
-    printf("  |                                              ____________________|_\n");
-    printf("  |  ___________________-------------------------                      `\\\n");
-    printf("  |/`--_                                                                 |\n");
-    printf("  ||[ ]||                                            ___________________/\n");
-    printf("   \\===/___________________--------------------------\n\n");
-    printf("\x1B[0m");
-}
-
-/* Outputs the header line to the console */
-void outputHeader()
-{
-    printf("╔═════════════════════════════════════════════════════════════════════════════╗\n");
-}
-
-/* Outputs the dividing line to the console */
-void outputDivider()
-{
-    printf("╠═════════════════════════════════════════════════════════════════════════════╣\n");
-}
-
-/* Outputs the footer line to the console */
-void outputFooter()
-{
-    printf("╚═════════════════════════════════════════════════════════════════════════════╝\n");
-}
-
-/* Outputs a message line to the console */
-void outputLine(char *message, const char color)
-{
-    printf("║ ");
-    changeColor(color);
-    printf("%s", message);
-    
-    printf("\x1B[0m");
-    
-    for(int i = 0; i < (75 - strlen(message)); i++)
-    {
-        printf(" ");
-    }
-    printf(" ║\n");
-}
-
-/* Outputs a message with variable line to the console */
-void outputVar(char *message, const char color, char *value)
-{
-    int i;
-    int valLength = 0;
-    
-    printf("║ ");
-    changeColor(color);
-    printf("%s", message);
-    
-    for(int i = 0; i < strlen(value); i++)
-    {
-        if(value[i] != '\n' && value[i] != '\r' )
-        {
-            printf("%c", value[i]);
-            valLength++;
-        }
-    }
-    
-    printf("\x1B[0m");
-    
-    for(int i = 0; i < (75 - strlen(message) - valLength); i++)
-    {
-        printf(" ");
-    }
-    printf(" ║\n");
-}
-
-/* Inputs a filename from the user */
-void inputFilename(FILE **file, char *filename, char *permission, char *purpose)
-{
-    int spacesTop = 20 - strlen(purpose);
-    int spacesBot = 30 - strlen(purpose);
-    
-    // Prompt user for the path to the file they want to select
-    printf(
-        "\n\n"
-        "╔════════════════════════════════════════╗\n"
-        "║ Please enter the filename of the file  ║\n"
-        "║ you would like to %s%*s ║\n"
-        "║                                        ║\n"
-        "║ eg. %s.txt%*s ║\n"
-        "╠════════════════════════════════════════╝\n"
-        "╚ ► ",purpose,spacesTop,"",purpose,spacesBot,"");
-    
-    scanf("%s", filename);
-    *file = fopen(filename, permission);
-    
-    // Check if the file is unreadable
-    while(*file == NULL)
-    {
-        // Print error message and re-ask for the file path
-        printf(
-            "╔════════════════════════════════════════╗\n"
-            "║ \x1B[31mError: File not found                 \x1B[0m ║\n"
-            "╠════════════════════════════════════════╣\n"
-            "║ Please select a valid filename         ║\n"
-            "╠════════════════════════════════════════╝\n"
-            "╚ ► ");
-        scanf("%s", filename);
-        *file = fopen(filename, permission);
-    }
-}
-
-/* Changes the console color */
-void changeColor(const char color)
-{
-    switch(color)
-    {
-        case 'R':
-            printf("\x1B[31m");
-            break;
-        case 'G':
-            printf("\x1B[32m");
-            break;
-        case 'Y':
-            printf("\x1B[33m");
-            break;
-        case 'B':
-            printf("\x1B[34m");
-            break;
-        case 'M':
-            printf("\x1b[35m");
-            break;
-        case 'C':
-            printf("\x1b[36m");
-            break;
-    }
+/*******************************************************************************
+ * 
+ * Project: The Super File Reader
+ * 
+ * Authors:
+ * Jack Romanous
+ * Braden Payne
+ * 
+ * Compile instructions:
+ * Ensure gcc is installed then run the following command:
+ * gcc multithreaded-file-reader.c -o multithreaded-file-reader -lpthread -lrt -lz
+ * Add -DHAVE_ZSTD -lzstd to read and write zstd files as well.
+ * 
+ * Usage:
+ * ./multithreaded-file-reader [options]
+ * ./multithreaded-file-reader [options] -i input.txt -o output.txt
+ * ./multithreaded-file-reader [options] -l manifest.txt
+ * 
+ * Without -i, -o or -l the program asks for the input and output files. With
+ * them it runs without prompts, "-" reads stdin or writes stdout, and all
+ * console messages go to stderr when stdout carries data. A manifest lists
+ * one "input output" pair per line and every pair is processed by the same
+ * threads and buffers. Run with -h for the other options.
+ * 
+ * Notes:
+ * Console output is buffered and only the start and summary lines are shown
+ * by default. -v traces every line as it passes through each thread, at most
+ * -r lines per second (default 1000, 0 for no limit), and -q shows nothing
+ * but errors.
+ * 
+ * ThreadB hands lines to ThreadC through a ring of line slots so that all
+ * three threads can work at once. The depth of the ring is set with -d
+ * (default 64). A depth of 0 keeps the original lockstep behaviour where
+ * ThreadA waits for ThreadC to consume each line before reading the next.
+ * Lines may be of any length. Each slot keeps its buffer from line to line
+ * and only grows it when a longer line arrives.
+ * 
+ * Lines are sent through the pipe as length-prefixed frames packed into
+ * batches of up to PIPE_BATCH_SIZE bytes, so only the real bytes of each
+ * line are written. -f fixed sends every line as MAX_LINE_SIZE bytes in its
+ * own write as the original program did, splitting longer lines into
+ * several writes that ThreadB joins again.
+ * 
+ * With -z ThreadA finds the end of the header once and then splices the
+ * rest of the input file into the pipe, and ThreadB splices it from the
+ * pipe into the output file, so the body never passes through user memory.
+ * 
+ * With -m ThreadA maps the input file instead of reading it with fgets and
+ * splits lines with a vectorised newline search. END_HEADER is found with a
+ * vectorised substring search in every mode. AVX2 is used when the CPU has
+ * it, otherwise SSE2, otherwise plain C.
+ * 
+ * With -p ThreadA maps the input file, finds the end of the header and
+ * splits the body into one range per worker, each starting on a line
+ * boundary. A pool of worker threads copies the ranges into the output file
+ * with pwrite at the matching offsets, from the output's current offset.
+ * An output that is appended to or cannot seek goes through the pipeline
+ * instead. -p 0 uses one worker per online CPU.
+ * 
+ * With -e uring ThreadA reads regular input files and ThreadC writes regular
+ * output files through io_uring, keeping URING_DEPTH reads or writes of
+ * URING_BUFFER_SIZE bytes in flight from registered buffers on a registered
+ * file. When the kernel has no io_uring the program falls back to stdio.
+ * 
+ * ThreadC takes the lines that are ready in the ring in batches and runs
+ * each line through a chain of filters in one pass before writing it. The
+ * chain always starts with the header filter, which drops lines up to and
+ * including END_HEADER. -g keeps lines matching a regular expression, -c
+ * keeps a list of fields split by the -t delimiter (default space), and -k
+ * reports the CRC-32 of the lines that reach it. These run in the order
+ * they are given on the command line.
+ * 
+ * ThreadC gathers the lines it keeps into a WRITER_BUFFER_SIZE buffer and
+ * writes it with writev, together with any line too long to fit. -y sets how
+ * the output is made durable: none (default), close to fsync it once it is
+ * written, or a number N to fdatasync every N MB and at the end. A third
+ * column in a manifest sets it for that job. -D writes with O_DIRECT from an
+ * aligned buffer, padding the last block and truncating the file after it.
+ * An output that is appended to or not at a block boundary stays buffered.
+ * 
+ * Inputs compressed with gzip or zstd are found by their magic bytes, or by
+ * a .gz or .zst name when they cannot be read ahead. A pipe such as stdin
+ * has neither, so it is copied as it is unless -Z names its codec. Outputs
+ * named .gz or .zst are compressed. Each compressed file gets a codec thread that
+ * runs alongside the pipeline and exchanges the plain data with ThreadA or
+ * ThreadC through a pipe, so the threads see an ordinary stream. -x sets
+ * the compression level.
+ * 
+ * ThreadA and ThreadB are joined by an anonymous pipe by default. -T ring
+ * replaces it with a ring of TRANSPORT_RING_SIZE bytes in memory, so lines
+ * are copied once and the threads only enter the kernel to wait for each
+ * other. -T shm puts the same ring in a shm_open segment with process-shared
+ * locks, which the -B benchmark uses to run the reader and the writer as
+ * separate processes. -a pins ThreadA and ThreadB, or the benchmark writer
+ * and reader, to two CPUs, such as CPUs on different NUMA nodes. -B sends a
+ * number of BENCH_LINE_SIZE lines one at a time through each transport and
+ * reports lines per second and the latency of each line.
+ * 
+ * With -s each thread counts the lines and bytes it handles and times its
+ * semaphore waits, pipe syscalls and file I/O into log2 histograms. The
+ * counters are written to the file as one line of JSON at the end of the
+ * run and whenever the program receives SIGUSR1.
+ * 
+ ******************************************************************************/
+
+/* --- Included Libraries --- */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <semaphore.h>
+#include <sys/time.h>
+#include <time.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <sched.h>
+#include <linux/io_uring.h>
+#include <regex.h>
+#include <limits.h>
+#include <zlib.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+/* --- Constant Definitions --- */
+
+#define MAX_LINE_SIZE 255
+#define END_HEADER "end_header"
+#define END_HEADER_LENGTH (sizeof(END_HEADER) - 1)
+#define MAX_FILENAME_SIZE 4096
+#define DEFAULT_RING_DEPTH 64
+#define PIPE_BATCH_SIZE (64 * 1024)
+#define SPLICE_CHUNK_SIZE (1024 * 1024)
+#define COPY_CHUNK_SIZE (8 * 1024 * 1024)
+#define TRANSPORT_RING_SIZE (1024 * 1024)
+#define BENCH_LINE_SIZE 64
+#define CONSOLE_BUFFER_SIZE (64 * 1024)
+#define OUTPUT_LINE_SIZE (MAX_FILENAME_SIZE + 256)
+#define DEFAULT_TRACE_RATE 1000
+#define TIME_BUCKETS 40
+#define URING_DEPTH 8
+#define URING_BUFFER_SIZE (1024 * 1024)
+#define FILTER_BATCH_SIZE 64
+#define WRITER_BUFFER_SIZE (1024 * 1024)
+#define DIRECT_ALIGNMENT 4096
+#define CODEC_BUFFER_SIZE (256 * 1024)
+#define MAX_FILTERS 16
+#define MAX_FIELD_RANGES 16
+
+/* Durability of an output file, SYNC_DEFAULT takes the -y setting */
+#define SYNC_DEFAULT -1
+#define SYNC_NONE 0
+#define SYNC_DATA 1
+#define SYNC_CLOSE 2
+
+/* Compression of a file */
+#define CODEC_NONE 0
+#define CODEC_GZIP 1
+#define CODEC_ZSTD 2
+
+/* Results of a filter */
+#define FILTER_DROP 0
+#define FILTER_KEEP 1
+
+/* I/O engines for reading input files and writing output files */
+#define ENGINE_STDIO 0
+#define ENGINE_URING 1
+
+/* Transports between ThreadA and ThreadB */
+#define TRANSPORT_PIPE 0
+#define TRANSPORT_RING 1
+#define TRANSPORT_SHM 2
+
+/* Threads of the pipeline that keep statistics */
+#define STAGE_A 0
+#define STAGE_B 1
+#define STAGE_C 2
+#define STAGE_COUNT 3
+
+/* Console log levels */
+#define LOG_QUIET 0
+#define LOG_INFO 1
+#define LOG_TRACE 2
+
+/* --- Structs --- */
+
+/* Line buffer that is reused from line to line and only grows */
+typedef struct LineBuffer
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+} LineBuffer;
+
+/* Count, total and log2 histogram of the time spent in one kind of call.
+ * Bucket i counts the calls that took less than 2^i nanoseconds. */
+typedef struct TimeStat
+{
+    int enabled;
+    unsigned long long count;
+    unsigned long long totalNs, maxNs;
+    unsigned long long buckets[TIME_BUCKETS];
+} TimeStat;
+
+/* Work done by one thread of the pipeline and where its time went */
+typedef struct StageStats
+{
+    const char *name;
+    unsigned long long lines, bytes;
+    TimeStat wait, pipe, file;
+} StageStats;
+
+/* Bounded ring of line slots between ThreadB (producer) and ThreadC (consumer).
+ * An empty line in a slot marks the end of the input. */
+typedef struct LineRing
+{
+    LineBuffer *slots;
+    int depth;
+    int head, tail;
+    sem_t filledSlots, emptySlots;
+    int ready;
+    TimeStat *producerWait, *consumerWait;
+} LineRing;
+
+/* Inclusive range of fields kept by the field filter */
+typedef struct FieldRange
+{
+    int first, last;
+} FieldRange;
+
+/* One transform in the chain ThreadC runs over each line. apply may change
+ * the line in place and returns FILTER_DROP to stop the line there. */
+typedef struct Filter
+{
+    int (*apply)(struct Filter *filter, LineBuffer *line);
+    void (*reset)(struct Filter *filter);
+    void (*report)(struct Filter *filter);
+    char *dropMessage;
+    char dropColor;
+    int headerPassed;
+    regex_t regex;
+    FieldRange ranges[MAX_FIELD_RANGES];
+    int rangeCount;
+    char delimiter;
+    uint32_t crc;
+    uint32_t crcTable[8][256];
+    unsigned long long checksumBytes;
+} Filter;
+
+/* Input file mapped into memory */
+typedef struct MappedFile
+{
+    const char *data;
+    size_t size;
+} MappedFile;
+
+/* Frames waiting to be written to the pipe in one batch */
+typedef struct PipeBatch
+{
+    char data[PIPE_BATCH_SIZE];
+    size_t used;
+    int lineOpen;
+} PipeBatch;
+
+/* Byte range of the body copied by one parallel worker */
+typedef struct CopyRange
+{
+    const char *data;
+    off_t start, end;
+    off_t outputOffset;
+    int writeFd;
+    pthread_t tid;
+} CopyRange;
+
+/* io_uring instance of one thread with its registered buffers and the
+ * state of the reads or writes in flight on its current file */
+typedef struct Uring
+{
+    int fd;
+    unsigned *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+    char *buffers;
+    int fixedBuffers;
+    int fixedFile;
+    int fileFd;
+    off_t offset;
+    off_t offsets[URING_DEPTH];
+    size_t lengths[URING_DEPTH];
+    int busy[URING_DEPTH];
+    int current;
+} Uring;
+
+/* Input and output file pair processed in one pass of the threads */
+typedef struct FileJob
+{
+    char readFilename[MAX_FILENAME_SIZE];
+    char writeFilename[MAX_FILENAME_SIZE];
+    int syncMode;
+    unsigned long long syncEvery;
+} FileJob;
+
+/* Gathers the lines ThreadC writes into one aligned buffer */
+typedef struct Writer
+{
+    char *buffer;
+    size_t used;
+    int fd;
+    int flags;
+    int direct;
+    int regular;
+    off_t start;            // file offset the writer started at
+    off_t written;
+    int syncMode;
+    unsigned long long syncEvery, unsynced;
+} Writer;
+
+/* Thread compressing or decompressing one file, it holds the real file and
+ * the pipeline reads or writes the plain data through a pipe */
+typedef struct Codec
+{
+    pthread_t tid;
+    int type;
+    int compress;
+    int level;
+    FILE *file;
+    int pipeFd;
+    int syncMode;
+    char *input, *output;
+    unsigned long long plainBytes, fileBytes;
+} Codec;
+
+/* Byte stream between one writer and one reader in shared memory, head and
+ * tail count every byte written and read so the ring is empty when they are
+ * equal, the lock only guards the counters and the data is copied outside it */
+typedef struct ByteRing
+{
+    pthread_mutex_t lock;
+    pthread_cond_t dataReady, spaceReady;
+    uint64_t head, tail;
+    int closed;
+    int shared;
+    char data[TRANSPORT_RING_SIZE];
+} ByteRing;
+
+/* One line of the transport benchmark, stamped when it is sent */
+typedef struct BenchLine
+{
+    uint64_t sentNs;
+    char text[BENCH_LINE_SIZE - sizeof(uint64_t)];
+} BenchLine;
+
+/* Transport and number of lines of one benchmark run */
+typedef struct BenchRun
+{
+    struct ThreadParams *params;
+    unsigned long lines;
+} BenchRun;
+
+/* Traffic through the pipe between ThreadA and ThreadB */
+typedef struct PipeStats
+{
+    unsigned long lines;
+    unsigned long writes, reads;
+    unsigned long long lineBytes, pipeBytes;
+} PipeStats;
+
+/* Rate-limited sink for the per-line trace messages */
+typedef struct TraceSink
+{
+    pthread_mutex_t lock;
+    long rate;
+    long windowCount;
+    time_t windowStart;
+    unsigned long dropped;
+} TraceSink;
+
+typedef struct ThreadParams
+{
+    int pipeFile[2];
+    int transport;
+    ByteRing *byteRing;
+    int cpus[2];
+    sem_t sem_A_to_B, sem_B_to_C, sem_C_to_A;
+    LineRing ring;
+    int lockstep;
+    int framed;
+    int zeroCopy;
+    int mapped;
+    int workers;
+    int engine;
+    int syncMode;
+    unsigned long long syncEvery;
+    int direct;
+    int level;
+    int inputCodec;         // codec of inputs that cannot be read ahead, from -Z
+    int writeFd;
+    int stdoutFd;
+    PipeStats pipeStats;
+    FileJob *jobs;
+    int jobCount;
+    int interactive;
+    int logLevel;
+    TraceSink trace;
+    Filter filters[MAX_FILTERS];
+    int filterCount;
+    StageStats stages[STAGE_COUNT];
+    FILE *statsFile;
+    uint64_t startNs;
+} ThreadParams;
+
+/* --- Prototypes --- */
+
+/* Initializes data and utilities used in thread params */
+void initializeData(ThreadParams *params, int depth);
+
+/* Allocates the line slots of a ring */
+void ringInit(LineRing *ring, int depth);
+
+/* Waits for a free slot and returns it to the producer */
+LineBuffer *ringReserve(LineRing *ring);
+
+/* Hands the reserved slot over to the consumer */
+void ringCommit(LineRing *ring);
+
+/* Returns up to max filled slots in order to the consumer, waiting only
+ * when none are left over from the last batch */
+int ringPeekBatch(LineRing *ring, LineBuffer **lines, int max);
+
+/* Hands the first count slots of a batch back to the producer */
+void ringReleaseBatch(LineRing *ring, int count);
+
+/* Frees the line slots of a ring */
+void ringDestroy(LineRing *ring);
+
+/* Grows a line buffer to hold at least capacity bytes */
+void lineReserve(LineBuffer *line, size_t capacity);
+
+/* Creates an empty byte ring, in a shm_open segment when it is shared between processes */
+ByteRing *byteRingCreate(int shared);
+
+/* Frees a byte ring */
+void byteRingDestroy(ByteRing *ring);
+
+/* Copies a whole buffer into the ring, waiting for the reader to make space */
+void byteRingWrite(ByteRing *ring, const char *buffer, size_t length);
+
+/* Copies up to length bytes out of the ring, returns 0 once it is closed and empty */
+size_t byteRingRead(ByteRing *ring, char *buffer, size_t length);
+
+/* Tells the reader no more data will be written */
+void byteRingClose(ByteRing *ring);
+
+/* Pins the calling thread to a CPU, a negative CPU leaves it unpinned */
+void pinThread(int cpu);
+
+/* Writes a whole buffer to the pipe */
+void pipeWrite(ThreadParams *params, const char *buffer, size_t length);
+
+/* Reads up to length bytes from the pipe, returns 0 once ThreadA has closed it */
+size_t pipeRead(ThreadParams *params, char *buffer, size_t length);
+
+/* Closes the writing end of the pipe */
+void pipeClose(ThreadParams *params);
+
+/* Adds a line to the batch, or writes it straight to the pipe in fixed mode
+ * split into MAX_LINE_SIZE writes */
+void pipeSendLine(ThreadParams *params, PipeBatch *batch, const char *line, uint32_t length);
+
+/* Writes the frames waiting in the batch to the pipe */
+void pipeFlush(ThreadParams *params, PipeBatch *batch);
+
+/* Sends the end of file marker for the current pipe mode and flushes the batch */
+void pipeEndJob(ThreadParams *params, PipeBatch *batch);
+
+/* Reads exactly length bytes from the pipe, returns 0 if the pipe is closed first */
+int pipeReadFull(ThreadParams *params, char *buffer, size_t length);
+
+/* Writes every line of the input file to the pipe */
+void pipeWriteLines(ThreadParams *params, PipeBatch *batch, FILE *readTxt, LineBuffer *line);
+
+/* Writes every line of the mapped input file to the pipe */
+void pipeWriteMapped(ThreadParams *params, PipeBatch *batch, MappedFile *map);
+
+/* Skips the header and sends the rest of the input file through the pipe in
+ * length-prefixed segments, splicing regular files without copying them */
+void pipeSpliceFile(ThreadParams *params, FILE *readTxt, MappedFile *map, LineBuffer *line);
+
+/* Splices each segment of the body from the pipe into the output file */
+void pipeSpliceOutput(ThreadParams *params);
+
+/* Copies the body of the mapped input file into the output file with a pool of workers */
+int parallelCopy(ThreadParams *params, MappedFile *map);
+
+/* This thread copies one range of the body into the output file */
+void *copyWorker(void *range);
+
+/* Moves up to length bytes between two descriptors with splice, copying when
+ * splice is unsupported */
+ssize_t spliceChunk(int fdIn, off_t *offsetIn, int fdOut, size_t length);
+
+/* Sets up an io_uring with registered buffers, returns -1 if the kernel has none */
+int uringInit(Uring *ring);
+
+/* Frees an io_uring set up with uringInit */
+void uringDestroy(Uring *ring);
+
+/* Registers a regular file for reads or writes from its current offset,
+ * returns -1 if the file cannot be used */
+int uringOpenFile(Uring *ring, int fd);
+
+/* Moves the file offset past the data read or written and releases the file */
+void uringCloseFile(Uring *ring);
+
+/* Submits a read or write of length bytes between a buffer and the file */
+void uringQueue(Uring *ring, int write, int index, size_t length, off_t offset);
+
+/* Waits for a read or write to complete, returns its result and buffer */
+int uringWait(Uring *ring, int *index);
+
+/* Copies data into the current buffer, writing each buffer once it is full */
+void uringWrite(Uring *ring, const char *data, size_t length);
+
+/* Writes the current buffer and waits for every write to complete */
+void uringFlush(Uring *ring);
+
+/* Waits for the write from a buffer and finishes it if it was short */
+void uringFinishWrite(Uring *ring);
+
+/* Reads the input file through io_uring and writes every line to the pipe,
+ * returns -1 if the file cannot be read this way */
+int pipeWriteUring(ThreadParams *params, PipeBatch *batch, Uring *ring, int fd, LineBuffer *line);
+
+/* Allocates the aligned buffer of a writer */
+void writerInit(Writer *writer);
+
+/* Starts writing to a file with a durability policy, returns -1 if O_DIRECT
+ * was asked for but the file cannot use it */
+int writerOpen(Writer *writer, int fd, int syncMode, unsigned long long syncEvery, int direct);
+
+/* Adds data to the buffer, writing the buffer once the data no longer fits */
+void writerWrite(Writer *writer, const char *data, size_t length);
+
+/* Writes the buffer followed by an optional extra block of data */
+void writerFlush(Writer *writer, const char *data, size_t length);
+
+/* Writes what is left, trims the O_DIRECT padding and syncs the file */
+void writerClose(Writer *writer);
+
+/* Makes a file durable as its sync mode asks */
+void syncFile(int fd, int syncMode);
+
+/* Reads a -y setting, returns -1 if it is not none, close or a number of MB */
+int parseSync(const char *text, int *syncMode, unsigned long long *syncEvery);
+
+/* Finds the compression of a file from its magic bytes or its name */
+int codecType(FILE *file, const char *filename, int compress, int inputCodec);
+
+/* Puts a codec thread between a compressed file and the pipeline, replacing
+ * the file with the plain end of a pipe */
+void codecStart(Codec *codec, FILE **file, const char *filename, int compress, int syncMode, int level,
+    int inputCodec);
+
+/* Waits for the codec thread to finish its file */
+void codecFinish(Codec *codec, int logLevel);
+
+/* This thread runs the codec of one file */
+void *codecThread(void *codec);
+
+/* Reads up to a buffer of data, returns 0 at the end */
+size_t codecRead(int fd, char *buffer, size_t size, const char *message);
+
+/* Writes all the data, returns -1 if the pipeline has stopped reading */
+int codecWrite(int fd, const char *data, size_t length, const char *message);
+
+/* Decompresses gzip or zlib data, including several gzip members in a row */
+void gzipDecompress(Codec *codec);
+
+/* Compresses plain data into a gzip file */
+void gzipCompress(Codec *codec);
+
+#ifdef HAVE_ZSTD
+/* Decompresses zstd data, including several frames in a row */
+void zstdDecompress(Codec *codec);
+
+/* Compresses plain data into a zstd file */
+void zstdCompress(Codec *codec);
+#endif
+
+/* Maps a whole regular file for sequential reading, returns -1 if it cannot be mapped */
+int mapFile(MappedFile *map, int fd);
+
+/* Unmaps a file mapped with mapFile */
+void unmapFile(MappedFile *map);
+
+/* Returns the offset just after the line holding END_HEADER, or -1 if there is none */
+off_t findBodyOffset(const char *data, size_t size);
+
+/* Returns the first occurrence of a byte in [start, end), or NULL */
+const char *scanByte(const char *start, const char *end, char byte);
+
+/* Returns the first occurrence of a string in [start, end), or NULL */
+const char *scanString(const char *start, const char *end, const char *needle, size_t needleLength);
+
+/* Scalar, SSE2 and AVX2 versions of scanByte and scanString */
+const char *scanByteScalar(const char *start, const char *end, char byte);
+const char *scanStringScalar(const char *start, const char *end, const char *needle, size_t needleLength);
+#ifdef HAVE_X86_SIMD
+const char *scanByteSSE2(const char *start, const char *end, char byte);
+const char *scanByteAVX2(const char *start, const char *end, char byte);
+const char *scanStringSSE2(const char *start, const char *end, const char *needle, size_t needleLength);
+const char *scanStringAVX2(const char *start, const char *end, const char *needle, size_t needleLength);
+#endif
+
+/* Reads fixed size lines from the pipe into the line ring until the end of
+ * the file, joining the pieces of lines that were split */
+void pipeReadFixed(ThreadParams *params);
+
+/* Reads length-prefixed frames from the pipe into the line ring until the end
+ * of the file, keeping any frames of the next file in the buffer */
+void pipeReadFramed(ThreadParams *params, PipeBatch *buffer);
+
+/* Returns the monotonic clock in nanoseconds */
+uint64_t clockNs();
+
+/* Returns the start time of a timed call, or 0 when the statistic is off */
+uint64_t timerStart(TimeStat *stat);
+
+/* Adds the time since start to a statistic */
+void timerStop(TimeStat *stat, uint64_t start);
+
+/* Waits on a semaphore and adds the time blocked to a statistic */
+void timedWait(TimeStat *stat, sem_t *sem);
+
+/* Writes the statistics of every thread to the stats file as one line of JSON */
+void outputStats(ThreadParams *params, int final);
+
+/* Writes one timing statistic as a JSON member */
+void outputTimeStat(FILE *file, const char *name, TimeStat *stat);
+
+/* This thread writes the statistics each time the program receives SIGUSR1 */
+void *statsThread(void *params);
+
+/* Adds an empty filter to the end of the chain */
+Filter *addFilter(ThreadParams *params);
+
+/* Runs a line through every filter in order, returns the filter that
+ * dropped it or NULL if it is kept */
+Filter *runFilters(ThreadParams *params, LineBuffer *line);
+
+/* Sets up the filter that drops lines up to and including END_HEADER */
+void filterHeaderInit(Filter *filter);
+int filterHeader(Filter *filter, LineBuffer *line);
+void filterHeaderReset(Filter *filter);
+
+/* Sets up the filter that keeps lines matching an extended regular expression */
+void filterRegexInit(Filter *filter, const char *pattern);
+int filterRegex(Filter *filter, LineBuffer *line);
+
+/* Sets up the filter that keeps a list of fields such as 1,3-5,7- */
+void filterFieldsInit(Filter *filter, const char *list);
+int filterFields(Filter *filter, LineBuffer *line);
+
+/* Sets up the filter that reports the CRC-32 of each file */
+void filterChecksumInit(Filter *filter);
+int filterChecksum(Filter *filter, LineBuffer *line);
+void filterChecksumReset(Filter *filter);
+void filterChecksumReport(Filter *filter);
+
+/* Adds an input and output file pair to the list of jobs */
+void addJob(ThreadParams *params, const char *readFilename, const char *writeFilename);
+
+/* Adds every "input output" pair listed in a manifest file to the list of jobs */
+void loadManifest(ThreadParams *params, const char *filename);
+
+/* Opens a file named on the command line or in a manifest, "-" is stdin or stdout */
+void openJobFile(ThreadParams *params, FILE **file, const char *filename, const char *permission);
+
+/* Outputs the bytes per line and syscalls per MB of the pipe */
+void outputPipeStats(PipeStats *stats);
+
+/* Sends lines through every transport and outputs their rate and latency */
+void benchTransports(ThreadParams *params, unsigned long lines);
+
+/* Sends lines one at a time through a transport and outputs the lines per
+ * second and latency seen by the reader */
+void benchTransport(ThreadParams *params, int transport, unsigned long lines, const char *name);
+
+/* This thread or process writes the benchmark lines */
+void *benchWriter(void *run);
+
+/* Returns the upper bound of the time under which a fraction of a statistic falls */
+uint64_t timeStatPercentile(TimeStat *stat, double fraction);
+
+/* Outputs the command line usage */
+void outputUsage(const char *program);
+
+/* This thread reads data from a file and writes each line to a pipe */
+void *ThreadA(void *params);
+
+/* This thread reads data from pipe used in ThreadA and writes it to the line ring */
+void *ThreadB(void *params);
+
+/* This thread reads from the line ring and outputs non-header to a file */
+void *ThreadC(void *params);
+
+/* Outputs the welcome banner to the console */
+void outputWelcome();
+
+/* Outputs the header line to the console */
+void outputHeader();
+
+/* Outputs the dividing line to the console */
+void outputDivider();
+
+/* Outputs the footer line to the console */
+void outputFooter();
+
+/* Outputs a message line to the console */
+void outputLine(char *message, const char color);
+
+/* Outputs a message with variable line to the console */
+void outputVar(char *message, const char color, char *value);
+
+/* Outputs a trace message with variable line unless the trace rate has been
+ * reached this second, optionally followed by the dividing line */
+void outputTrace(TraceSink *trace, char *message, const char color, const char *value, int divider);
+
+/* Formats a message with variable line for the console, returns its length */
+int formatLine(char *buffer, const char *message, const char color, const char *value);
+
+/* Inputs a filename from the user */
+void inputFilename(FILE **file, char *filename, char *permission, char *purpose);
+
+/* Changes the console color */
+void changeColor(const char color);
+
+/* Returns the escape code for a console color */
+const char *colorCode(const char color);
+
+/* --- Main Code --- */
+int main(int argc, char const *argv[])
+{
+    // Initialise variables
+    int result, option, i;
+    int depth = DEFAULT_RING_DEPTH;
+    const char *readFilename = NULL, *writeFilename = NULL;
+    char value[64];
+    const char *statsFilename = NULL;
+    char delimiter = ' ';
+    unsigned long benchLines = 0;
+    pthread_t tid1, tid2, tid3, statsTid;
+    pthread_attr_t attr;
+    sigset_t signals;
+    struct io_uring_params uringSetup;
+    ThreadParams params;
+    
+    // Buffer the console instead of writing it a character at a time
+    setvbuf(stdout, NULL, _IOFBF, CONSOLE_BUFFER_SIZE);
+    
+    // Read options from the command line
+    params.logLevel = LOG_INFO;
+    params.trace.rate = DEFAULT_TRACE_RATE;
+    params.framed = 1;
+    params.zeroCopy = 0;
+    params.mapped = 0;
+    params.workers = -1;
+    params.engine = ENGINE_STDIO;
+    params.transport = TRANSPORT_PIPE;
+    params.byteRing = NULL;
+    params.cpus[0] = -1;
+    params.cpus[1] = -1;
+    params.jobs = NULL;
+    params.syncMode = SYNC_NONE;
+    params.syncEvery = 0;
+    params.direct = 0;
+    params.level = -1;
+    params.inputCodec = CODEC_NONE;
+    params.jobCount = 0;
+    params.filterCount = 0;
+    filterHeaderInit(addFilter(&params));
+    while((option = getopt(argc, (char * const *)argv, "i:o:l:d:f:zmp:e:y:Dx:Z:T:a:B:g:c:t:kqvr:s:h")) != -1)
+    {
+        switch(option)
+        {
+            case 'i':
+                readFilename = optarg;
+                break;
+            case 'o':
+                writeFilename = optarg;
+                break;
+            case 'l':
+                loadManifest(&params, optarg);
+                break;
+            case 'd':
+                depth = atoi(optarg);
+                if(depth < 0)
+                {
+                    outputUsage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'f':
+                if(strcmp(optarg, "framed") == 0)
+                {
+                    params.framed = 1;
+                }
+                else if(strcmp(optarg, "fixed") == 0)
+                {
+                    params.framed = 0;
+                }
+                else
+                {
+                    outputUsage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'z':
+                params.zeroCopy = 1;
+                break;
+            case 'm':
+                params.mapped = 1;
+                break;
+            case 'p':
+                params.workers = atoi(optarg);
+                if(params.workers <= 0)
+                {
+                    params.workers = sysconf(_SC_NPROCESSORS_ONLN);
+                }
+                params.mapped = 1;
+                break;
+            case 'e':
+                if(strcmp(optarg, "stdio") == 0)
+                {
+                    params.engine = ENGINE_STDIO;
+                }
+                else if(strcmp(optarg, "uring") == 0)
+                {
+                    params.engine = ENGINE_URING;
+                }
+                else
+                {
+                    outputUsage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'y':
+                if(parseSync(optarg, &(params.syncMode), &(params.syncEvery)) < 0)
+                {
+                    outputUsage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'D':
+                params.direct = 1;
+                break;
+            case 'x':
+                params.level = atoi(optarg);
+                if(params.level < 0 || params.level > 19)
+                {
+                    outputUsage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'Z':
+                if(strcmp(optarg, "gzip") == 0)
+                {
+                    params.inputCodec = CODEC_GZIP;
+                }
+                else if(strcmp(optarg, "zstd") == 0)
+                {
+                    params.inputCodec = CODEC_ZSTD;
+                }
+                else
+                {
+                    outputUsage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'T':
+                if(strcmp(optarg, "pipe") == 0)
+                {
+                    params.transport = TRANSPORT_PIPE;
+                }
+                else if(strcmp(optarg, "ring") == 0)
+                {
+                    params.transport = TRANSPORT_RING;
+                }
+                else if(strcmp(optarg, "shm") == 0)
+                {
+                    params.transport = TRANSPORT_SHM;
+                }
+                else
+                {
+                    outputUsage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'a':
+                if(sscanf(optarg, "%d,%d", &(params.cpus[0]), &(params.cpus[1])) != 2
+                    || params.cpus[0] < 0 || params.cpus[1] < 0)
+                {
+                    outputUsage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'B':
+                benchLines = strtoul(optarg, NULL, 10);
+                if(benchLines == 0)
+                {
+                    outputUsage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'g':
+                filterRegexInit(addFilter(&params), optarg);
+                break;
+            case 'c':
+                filterFieldsInit(addFilter(&params), optarg);
+                break;
+            case 't':
+                if(strlen(optarg) != 1)
+                {
+                    outputUsage(argv[0]);
+                    exit(1);
+                }
+                delimiter = optarg[0];
+                break;
+            case 'k':
+                filterChecksumInit(addFilter(&params));
+                break;
+            case 'q':
+                params.logLevel = LOG_QUIET;
+                break;
+            case 'v':
+                params.logLevel = LOG_TRACE;
+                break;
+            case 'r':
+                params.trace.rate = atol(optarg);
+                if(params.trace.rate < 0)
+                {
+                    outputUsage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 's':
+                statsFilename = optarg;
+                break;
+            default:
+                outputUsage(argv[0]);
+                exit(option == 'h' ? 0 : 1);
+        }
+    }
+    
+    if(optind < argc)
+    {
+        outputUsage(argv[0]);
+        exit(1);
+    }
+    
+    // Filters only see lines that pass through ThreadC
+    if(params.filterCount > 1 && (params.zeroCopy || params.workers > 0))
+    {
+        fprintf(stderr, "Error: -g, -c and -k cannot be used with -z or -p\n");
+        exit(1);
+    }
+    if(params.direct && (params.zeroCopy || params.workers > 0 || params.engine == ENGINE_URING))
+    {
+        fprintf(stderr, "Error: -D cannot be used with -z, -p or -e uring\n");
+        exit(1);
+    }
+    if(params.zeroCopy && params.transport != TRANSPORT_PIPE)
+    {
+        fprintf(stderr, "Error: -z splices through the pipe and cannot be used with -T ring or shm\n");
+        exit(1);
+    }
+    
+    // The benchmark replaces the normal run
+    if(benchLines > 0)
+    {
+        benchTransports(&params, benchLines);
+        return 0;
+    }
+    for(i = 0; i < params.filterCount; i++)
+    {
+        params.filters[i].delimiter = delimiter;
+    }
+    
+    // Files given on the command line default to the standard streams
+    if(readFilename != NULL || writeFilename != NULL)
+    {
+        addJob(&params, readFilename ? readFilename : "-", writeFilename ? writeFilename : "-");
+    }
+    
+    // Without files on the command line ask the user for one pair
+    params.interactive = (params.jobCount == 0);
+    if(params.interactive)
+    {
+        addJob(&params, "", "");
+    }
+    
+    // Keep stdout for data if any job writes to it and send the console to stderr
+    params.stdoutFd = STDOUT_FILENO;
+    for(i = 0; i < params.jobCount; i++)
+    {
+        if(strcmp(params.jobs[i].writeFilename, "-") == 0)
+        {
+            fflush(stdout);
+            params.stdoutFd = dup(STDOUT_FILENO);
+            dup2(STDERR_FILENO, STDOUT_FILENO);
+            break;
+        }
+    }
+    
+    // Output banner to the console
+    if(params.interactive)
+    {
+        outputWelcome();
+    }
+    
+    // Check the kernel supports io_uring before the threads set up their own
+    if(params.engine == ENGINE_URING)
+    {
+        result = syscall(__NR_io_uring_setup, 1, memset(&uringSetup, 0, sizeof(uringSetup)));
+        if(result < 0)
+        {
+            if(params.logLevel >= LOG_INFO)
+            {
+                perror("io_uring unavailable, using stdio");
+            }
+            params.engine = ENGINE_STDIO;
+        }
+        else
+        {
+            close(result);
+        }
+    }
+    
+    // Open the statistics file, - is stderr
+    params.statsFile = NULL;
+    if(statsFilename != NULL)
+    {
+        params.statsFile = (strcmp(statsFilename, "-") == 0) ? stderr : fopen(statsFilename, "w");
+        if(params.statsFile == NULL)
+        {
+            perror(statsFilename);
+            exit(1);
+        }
+    }
+    
+    // Initialise semaphores and line ring
+    initializeData(&params, depth);
+    pthread_attr_init(&attr);
+    
+    // Create pipe, or the ring that replaces it
+    if(params.transport == TRANSPORT_PIPE)
+    {
+        result = pipe(params.pipeFile);
+        if(result < 0)
+        {
+            perror("Error creating pipe");
+            exit(1);
+        }
+    }
+    else
+    {
+        params.byteRing = byteRingCreate(params.transport == TRANSPORT_SHM);
+    }
+    
+    // Leave SIGUSR1 to the statistics thread, every thread inherits the mask
+    if(params.statsFile != NULL)
+    {
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGUSR1);
+        pthread_sigmask(SIG_BLOCK, &signals, NULL);
+        
+        if(pthread_create(&statsTid, &attr, statsThread, (void*)(&params))!=0)
+        {
+            perror("Error creating threads: ");
+            exit(-1);
+        }
+    }
+    
+    // Create threads
+    if(pthread_create(&tid1, &attr, ThreadA, (void*)(&params))!=0)
+    {
+        perror("Error creating threads: ");
+        exit(-1);
+    }
+    
+    if(pthread_create(&tid2, &attr, ThreadB, (void*)(&params))!=0)
+    {
+        perror("Error creating threads: ");
+        exit(-1);
+    }
+    
+    if(pthread_create(&tid3, &attr, ThreadC, (void*)(&params))!=0)
+    {
+        perror("Error creating threads: ");
+        exit(-1);
+    }
+    
+    // Wait on threads to finish
+    pthread_join(tid1, NULL);
+    pthread_join(tid2, NULL);
+    pthread_join(tid3, NULL);
+    
+    // Output the summary once ThreadA has counted its last write
+    if(params.logLevel >= LOG_INFO)
+    {
+        // Report trace lines left out to keep within the trace rate
+        if(params.trace.dropped > 0)
+        {
+            snprintf(value, sizeof(value), "%lu", params.trace.dropped);
+            outputVar("TRACE: Lines over the rate limit: ", 'C', value);
+        }
+        
+        outputPipeStats(&(params.pipeStats));
+        outputFooter();
+    }
+    
+    // Stop the statistics thread and write the final statistics
+    if(params.statsFile != NULL)
+    {
+        pthread_cancel(statsTid);
+        pthread_join(statsTid, NULL);
+        outputStats(&params, 1);
+        if(params.statsFile != stderr)
+        {
+            fclose(params.statsFile);
+        }
+    }
+    
+    ringDestroy(&(params.ring));
+    if(params.byteRing != NULL)
+    {
+        byteRingDestroy(params.byteRing);
+    }
+    pthread_mutex_destroy(&(params.trace.lock));
+    for(i = 0; i < params.filterCount; i++)
+    {
+        if(params.filters[i].apply == filterRegex)
+        {
+            regfree(&(params.filters[i].regex));
+        }
+    }
+    free(params.jobs);
+    
+    return 0;
+}
+
+/* Initializes data and utilities used in thread params */
+void initializeData(ThreadParams *params, int depth) 
+{
+    if(sem_init(&(params->sem_A_to_B), 0, 1))
+    {
+        perror("Error initializing sem_A_to_B semaphore");
+        exit(0);
+    }
+    
+    if(sem_init(&(params->sem_B_to_C), 0, 0))
+    {
+        perror("Error initializing sem_B_to_C semaphore");
+        exit(0);
+    }
+    
+    if(sem_init(&(params->sem_C_to_A), 0, 0))
+    {
+        perror("Error initializing sem_C_to_A semaphore");
+        exit(0);
+    }
+    
+    // A depth of 0 runs the threads in lockstep through a single slot
+    params->lockstep = (depth == 0);
+    memset(&(params->pipeStats), 0, sizeof(params->pipeStats));
+    ringInit(&(params->ring), params->lockstep ? 1 : depth);
+    
+    // The trace rate is counted per second of the monotonic clock
+    if(pthread_mutex_init(&(params->trace.lock), NULL))
+    {
+        perror("Error initializing trace lock");
+        exit(0);
+    }
+    params->trace.windowCount = 0;
+    params->trace.windowStart = 0;
+    params->trace.dropped = 0;
+    
+    // Statistics are only timed when they will be written out
+    memset(params->stages, 0, sizeof(params->stages));
+    params->stages[STAGE_A].name = "ThreadA";
+    params->stages[STAGE_B].name = "ThreadB";
+    params->stages[STAGE_C].name = "ThreadC";
+    for(int i = 0; i < STAGE_COUNT; i++)
+    {
+        params->stages[i].wait.enabled = (params->statsFile != NULL);
+        params->stages[i].pipe.enabled = (params->statsFile != NULL);
+        params->stages[i].file.enabled = (params->statsFile != NULL);
+    }
+    params->ring.producerWait = &(params->stages[STAGE_B].wait);
+    params->ring.consumerWait = &(params->stages[STAGE_C].wait);
+    params->startNs = clockNs();
+    
+    return;
+}
+
+/* Allocates the line slots of a ring */
+void ringInit(LineRing *ring, int depth)
+{
+    int i;
+    
+    ring->slots = malloc((size_t)depth * sizeof(*ring->slots));
+    if(ring->slots == NULL)
+    {
+        perror("Error allocating line ring");
+        exit(0);
+    }
+    
+    // Start every slot with room for a fixed size line
+    for(i = 0; i < depth; i++)
+    {
+        ring->slots[i].data = NULL;
+        ring->slots[i].length = 0;
+        ring->slots[i].capacity = 0;
+        lineReserve(&(ring->slots[i]), MAX_LINE_SIZE);
+    }
+    
+    ring->depth = depth;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->ready = 0;
+    
+    if(sem_init(&(ring->filledSlots), 0, 0) || sem_init(&(ring->emptySlots), 0, depth))
+    {
+        perror("Error initializing line ring semaphores");
+        exit(0);
+    }
+}
+
+/* Waits for a free slot and returns it to the producer */
+LineBuffer *ringReserve(LineRing *ring)
+{
+    timedWait(ring->producerWait, &(ring->emptySlots));
+    return &(ring->slots[ring->head]);
+}
+
+/* Hands the reserved slot over to the consumer */
+void ringCommit(LineRing *ring)
+{
+    ring->head = (ring->head + 1) % ring->depth;
+    sem_post(&(ring->filledSlots));
+}
+
+/* Returns up to max filled slots in order to the consumer, waiting only
+ * when none are left over from the last batch */
+int ringPeekBatch(LineRing *ring, LineBuffer **lines, int max)
+{
+    int i;
+    
+    if(ring->ready == 0)
+    {
+        timedWait(ring->consumerWait, &(ring->filledSlots));
+        ring->ready = 1;
+    }
+    
+    // Take every other slot that is already filled without blocking
+    while(ring->ready < max && sem_trywait(&(ring->filledSlots)) == 0)
+    {
+        ring->ready++;
+    }
+    
+    for(i = 0; i < ring->ready && i < max; i++)
+    {
+        lines[i] = &(ring->slots[(ring->tail + i) % ring->depth]);
+    }
+    
+    return i;
+}
+
+/* Hands the first count slots of a batch back to the producer */
+void ringReleaseBatch(LineRing *ring, int count)
+{
+    ring->tail = (ring->tail + count) % ring->depth;
+    ring->ready -= count;
+    
+    while(count-- > 0)
+    {
+        sem_post(&(ring->emptySlots));
+    }
+}
+
+/* Frees the line slots of a ring */
+void ringDestroy(LineRing *ring)
+{
+    int i;
+    
+    sem_destroy(&(ring->filledSlots));
+    sem_destroy(&(ring->emptySlots));
+    for(i = 0; i < ring->depth; i++)
+    {
+        free(ring->slots[i].data);
+    }
+    free(ring->slots);
+}
+
+/* Grows a line buffer to hold at least capacity bytes */
+void lineReserve(LineBuffer *line, size_t capacity)
+{
+    size_t newCapacity = line->capacity;
+    char *data;
+    
+    if(capacity <= line->capacity)
+    {
+        return;
+    }
+    
+    // Double the buffer so a run of long lines only grows it a few times
+    if(newCapacity < MAX_LINE_SIZE)
+    {
+        newCapacity = MAX_LINE_SIZE;
+    }
+    while(newCapacity < capacity)
+    {
+        newCapacity *= 2;
+    }
+    
+    data = realloc(line->data, newCapacity);
+    if(data == NULL)
+    {
+        perror("Error allocating line buffer");
+        exit(1);
+    }
+    
+    line->data = data;
+    line->capacity = newCapacity;
+}
+
+/* This thread reads data from a file and writes each line to a pipe */
+void *ThreadA(void *params) 
+{
+    // Initialise variables
+    ThreadParams *A_thread_params = (ThreadParams *)(params);
+    FileJob *job;
+    MappedFile map;
+    PipeBatch batch;
+    LineBuffer line;
+    Uring uring;
+    Codec codec;
+    FILE* readTxt;
+    int i;
+    
+    batch.used = 0;
+    batch.lineOpen = 0;
+    line.data = NULL;
+    line.length = 0;
+    line.capacity = 0;
+    uring.fd = -1;
+    if(A_thread_params->engine == ENGINE_URING)
+    {
+        uringInit(&uring);
+    }
+    pinThread(A_thread_params->cpus[0]);
+    
+    // Wait for the first turn at the console
+    timedWait(&(A_thread_params->stages[STAGE_A].wait), &(A_thread_params->sem_A_to_B));
+    
+    for(i = 0; i < A_thread_params->jobCount; i++)
+    {
+        job = &(A_thread_params->jobs[i]);
+        
+        // Get name of input file from user or from the command line
+        if(A_thread_params->interactive)
+        {
+            inputFilename(&readTxt,job->readFilename,"r","import");
+        }
+        else
+        {
+            openJobFile(A_thread_params, &readTxt, job->readFilename, "r");
+        }
+        codecStart(&codec, &readTxt, job->readFilename, 0, SYNC_NONE, A_thread_params->level,
+            A_thread_params->inputCodec);
+        sem_post(&(A_thread_params->sem_B_to_C));
+        
+        // Wait for ThreadC to open the output file
+        timedWait(&(A_thread_params->stages[STAGE_A].wait), &(A_thread_params->sem_A_to_B));
+        
+        // Map the input file if asked to, falling back to stdio when it cannot be mapped
+        if(!A_thread_params->mapped || mapFile(&map, fileno(readTxt)) < 0)
+        {
+            map.data = NULL;
+        }
+        
+        // Send the input file through the pipe
+        if(A_thread_params->workers > 0 && map.data != NULL && parallelCopy(A_thread_params, &map) == 0)
+        {
+            // The workers wrote the body directly, nothing goes through the pipe
+        }
+        else if(A_thread_params->zeroCopy)
+        {
+            pipeSpliceFile(A_thread_params, readTxt, &map, &line);
+        }
+        else if(map.data != NULL)
+        {
+            pipeWriteMapped(A_thread_params, &batch, &map);
+        }
+        else if(uring.fd >= 0 && pipeWriteUring(A_thread_params, &batch, &uring, fileno(readTxt), &line) == 0)
+        {
+            // The file was read through io_uring
+        }
+        else
+        {
+            pipeWriteLines(A_thread_params, &batch, readTxt, &line);
+        }
+        
+        // Tell ThreadB this file is finished and close it
+        pipeEndJob(A_thread_params, &batch);
+        unmapFile(&map);
+        fclose(readTxt);
+        codecFinish(&codec, A_thread_params->logLevel);
+        
+        if(A_thread_params->logLevel >= LOG_TRACE)
+        {
+            outputLine("SUCCESS: Closed input file", 'Y');
+        }
+    }
+    
+    // Close the write end of the pipe, there are no more files
+    pipeClose(A_thread_params);
+    free(line.data);
+    uringDestroy(&uring);
+    
+    return NULL;
+}
+
+/* This thread reads data from pipe used in ThreadA and writes it to the line ring */
+void *ThreadB(void *params) 
+{
+    // Initialise variables
+    ThreadParams *B_thread_params = (ThreadParams *)(params);
+    PipeBatch buffer;
+    LineBuffer *line;
+    int i;
+    
+    buffer.used = 0;
+    pinThread(B_thread_params->cpus[1]);
+    
+    for(i = 0; i < B_thread_params->jobCount; i++)
+    {
+        // Thread B has no file to initialise so move to C
+        timedWait(&(B_thread_params->stages[STAGE_B].wait), &(B_thread_params->sem_B_to_C));
+        sem_post(&(B_thread_params->sem_C_to_A));
+        
+        // Move lines from the pipe into the ring until ThreadA ends the file
+        if(B_thread_params->zeroCopy)
+        {
+            // Wait for ThreadC to open the output file
+            timedWait(&(B_thread_params->stages[STAGE_B].wait), &(B_thread_params->sem_B_to_C));
+            pipeSpliceOutput(B_thread_params);
+        }
+        else if(B_thread_params->framed)
+        {
+            pipeReadFramed(B_thread_params, &buffer);
+        }
+        else
+        {
+            pipeReadFixed(B_thread_params);
+        }
+        
+        // Pass an empty line to ThreadC to mark the end of the file
+        line = ringReserve(&(B_thread_params->ring));
+        line->length = 0;
+        line->data[0] = '\0';
+        ringCommit(&(B_thread_params->ring));
+    }
+    
+    return NULL;
+}
+
+
+/* Creates an empty byte ring, in a shm_open segment when it is shared between processes */
+ByteRing *byteRingCreate(int shared)
+{
+    ByteRing *ring;
+    pthread_mutexattr_t lockAttr;
+    pthread_condattr_t condAttr;
+    char name[64];
+    int fd;
+    
+    if(shared)
+    {
+        // The segment is only named long enough to map it, forked processes share the mapping
+        snprintf(name, sizeof(name), "/multithreaded-file-reader-%d", (int)getpid());
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if(fd < 0)
+        {
+            perror("Error creating shared memory");
+            exit(1);
+        }
+        shm_unlink(name);
+        
+        if(ftruncate(fd, sizeof(ByteRing)) < 0)
+        {
+            perror("Error sizing shared memory");
+            exit(1);
+        }
+        ring = mmap(NULL, sizeof(ByteRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(ring == MAP_FAILED)
+        {
+            perror("Error mapping shared memory");
+            exit(1);
+        }
+    }
+    else
+    {
+        ring = malloc(sizeof(ByteRing));
+        if(ring == NULL)
+        {
+            perror("Error allocating byte ring");
+            exit(1);
+        }
+    }
+    
+    pthread_mutexattr_init(&lockAttr);
+    pthread_condattr_init(&condAttr);
+    pthread_mutexattr_setpshared(&lockAttr, shared ? PTHREAD_PROCESS_SHARED : PTHREAD_PROCESS_PRIVATE);
+    pthread_condattr_setpshared(&condAttr, shared ? PTHREAD_PROCESS_SHARED : PTHREAD_PROCESS_PRIVATE);
+    if(pthread_mutex_init(&(ring->lock), &lockAttr) != 0
+        || pthread_cond_init(&(ring->dataReady), &condAttr) != 0
+        || pthread_cond_init(&(ring->spaceReady), &condAttr) != 0)
+    {
+        fprintf(stderr, "Error initializing byte ring\n");
+        exit(1);
+    }
+    pthread_mutexattr_destroy(&lockAttr);
+    pthread_condattr_destroy(&condAttr);
+    
+    ring->head = 0;
+    ring->tail = 0;
+    ring->closed = 0;
+    ring->shared = shared;
+    return ring;
+}
+
+/* Frees a byte ring */
+void byteRingDestroy(ByteRing *ring)
+{
+    pthread_mutex_destroy(&(ring->lock));
+    pthread_cond_destroy(&(ring->dataReady));
+    pthread_cond_destroy(&(ring->spaceReady));
+    if(ring->shared)
+    {
+        munmap(ring, sizeof(ByteRing));
+    }
+    else
+    {
+        free(ring);
+    }
+}
+
+/* Copies a whole buffer into the ring, waiting for the reader to make space */
+void byteRingWrite(ByteRing *ring, const char *buffer, size_t length)
+{
+    size_t space, offset, count;
+    
+    while(length > 0)
+    {
+        pthread_mutex_lock(&(ring->lock));
+        while(ring->head - ring->tail == TRANSPORT_RING_SIZE)
+        {
+            pthread_cond_wait(&(ring->spaceReady), &(ring->lock));
+        }
+        space = TRANSPORT_RING_SIZE - (ring->head - ring->tail);
+        offset = ring->head % TRANSPORT_RING_SIZE;
+        pthread_mutex_unlock(&(ring->lock));
+        
+        // Copy up to the end of the ring, the rest wraps round on the next pass
+        count = length;
+        if(count > space)
+        {
+            count = space;
+        }
+        if(count > TRANSPORT_RING_SIZE - offset)
+        {
+            count = TRANSPORT_RING_SIZE - offset;
+        }
+        memcpy(ring->data + offset, buffer, count);
+        
+        pthread_mutex_lock(&(ring->lock));
+        ring->head += count;
+        pthread_cond_signal(&(ring->dataReady));
+        pthread_mutex_unlock(&(ring->lock));
+        
+        buffer += count;
+        length -= count;
+    }
+}
+
+/* Copies up to length bytes out of the ring, returns 0 once it is closed and empty */
+size_t byteRingRead(ByteRing *ring, char *buffer, size_t length)
+{
+    size_t available, offset, count;
+    
+    pthread_mutex_lock(&(ring->lock));
+    while(ring->head == ring->tail && !ring->closed)
+    {
+        pthread_cond_wait(&(ring->dataReady), &(ring->lock));
+    }
+    available = ring->head - ring->tail;
+    offset = ring->tail % TRANSPORT_RING_SIZE;
+    pthread_mutex_unlock(&(ring->lock));
+    
+    // Copy up to the end of the ring, like a short read from a pipe
+    count = length;
+    if(count > available)
+    {
+        count = available;
+    }
+    if(count > TRANSPORT_RING_SIZE - offset)
+    {
+        count = TRANSPORT_RING_SIZE - offset;
+    }
+    if(count == 0)
+    {
+        return 0;
+    }
+    memcpy(buffer, ring->data + offset, count);
+    
+    pthread_mutex_lock(&(ring->lock));
+    ring->tail += count;
+    pthread_cond_signal(&(ring->spaceReady));
+    pthread_mutex_unlock(&(ring->lock));
+    
+    return count;
+}
+
+/* Tells the reader no more data will be written */
+void byteRingClose(ByteRing *ring)
+{
+    pthread_mutex_lock(&(ring->lock));
+    ring->closed = 1;
+    pthread_cond_signal(&(ring->dataReady));
+    pthread_mutex_unlock(&(ring->lock));
+}
+
+/* Pins the calling thread to a CPU, a negative CPU leaves it unpinned */
+void pinThread(int cpu)
+{
+    cpu_set_t cpus;
+    
+    if(cpu < 0)
+    {
+        return;
+    }
+    
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if(sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+    {
+        perror("Error pinning thread to CPU");
+        exit(1);
+    }
+}
+
+/* Writes a whole buffer to the pipe */
+void pipeWrite(ThreadParams *params, const char *buffer, size_t length)
+{
+    TimeStat *stat = &(params->stages[STAGE_A].pipe);
+    uint64_t start;
+    ssize_t result;
+    
+    // The ring takes the whole buffer in one call
+    if(params->byteRing != NULL)
+    {
+        start = timerStart(stat);
+        byteRingWrite(params->byteRing, buffer, length);
+        timerStop(stat, start);
+        params->pipeStats.writes++;
+        params->pipeStats.pipeBytes += length;
+        return;
+    }
+    
+    while(length > 0)
+    {
+        start = timerStart(stat);
+        result = write(params->pipeFile[1], buffer, length);
+        timerStop(stat, start);
+        if(result < 0)
+        { 
+            perror("Error writing to pipe");  
+            exit(2);
+        }
+        
+        params->pipeStats.writes++;
+        params->pipeStats.pipeBytes += result;
+        buffer += result;
+        length -= result;
+    }
+}
+
+/* Adds a line to the batch, or writes it straight to the pipe in fixed mode
+ * split into MAX_LINE_SIZE writes */
+void pipeSendLine(ThreadParams *params, PipeBatch *batch, const char *line, uint32_t length)
+{
+    char txtLine[MAX_LINE_SIZE];
+    uint32_t chunkLength;
+    uint32_t sent;
+    
+    params->pipeStats.lines++;
+    params->pipeStats.lineBytes += length;
+    params->stages[STAGE_A].lines++;
+    params->stages[STAGE_A].bytes += length;
+    
+    // Write line to pipe
+    if(params->framed)
+    {
+        // Send the batch once the next frame no longer fits
+        if(batch->used + sizeof(length) + length > sizeof(batch->data))
+        {
+            pipeFlush(params, batch);
+        }
+        
+        // Frames longer than a batch are written straight from the line
+        if(sizeof(length) + length > sizeof(batch->data))
+        {
+            pipeWrite(params, (char *)&length, sizeof(length));
+            pipeWrite(params, line, length);
+        }
+        else
+        {
+            memcpy(batch->data + batch->used, &length, sizeof(length));
+            memcpy(batch->data + batch->used + sizeof(length), line, length);
+            batch->used += sizeof(length) + length;
+        }
+        
+        // ThreadC cannot consume the line in lockstep mode until it is sent
+        if(params->lockstep)
+        {
+            pipeFlush(params, batch);
+        }
+    }
+    else
+    {
+        // Split long lines the same way fgets would
+        for(sent = 0; sent < length; sent += chunkLength)
+        {
+            chunkLength = length - sent;
+            if(chunkLength > MAX_LINE_SIZE - 1)
+            {
+                chunkLength = MAX_LINE_SIZE - 1;
+            }
+            
+            memcpy(txtLine, line + sent, chunkLength);
+            txtLine[chunkLength] = '\0';
+            pipeWrite(params, txtLine, MAX_LINE_SIZE);
+        }
+        
+        // A last line with no newline that fills its final write only ends at
+        // the end marker, so ThreadC cannot consume it before then
+        batch->lineOpen = (length % (MAX_LINE_SIZE - 1) == 0 && line[length - 1] != '\n');
+    }
+    
+    if(params->logLevel >= LOG_TRACE)
+    {
+        chunkLength = (length < MAX_LINE_SIZE - 1) ? length : MAX_LINE_SIZE - 1;
+        memcpy(txtLine, line, chunkLength);
+        txtLine[chunkLength] = '\0';
+        outputTrace(&(params->trace), "THREADA: Output line to pipe: ", 'M', txtLine, 0);
+    }
+    
+    // In lockstep mode wait for ThreadC to consume the line
+    if(params->lockstep && !batch->lineOpen)
+    {
+        timedWait(&(params->stages[STAGE_A].wait), &(params->sem_A_to_B));
+    }
+}
+
+/* Reads up to length bytes from the pipe, returns 0 once ThreadA has closed it */
+size_t pipeRead(ThreadParams *params, char *buffer, size_t length)
+{
+    TimeStat *stat = &(params->stages[STAGE_B].pipe);
+    uint64_t start;
+    ssize_t result;
+    
+    start = timerStart(stat);
+    if(params->byteRing != NULL)
+    {
+        result = byteRingRead(params->byteRing, buffer, length);
+    }
+    else
+    {
+        result = read(params->pipeFile[0], buffer, length);
+    }
+    timerStop(stat, start);
+    if(result < 0)
+    {
+        perror("Error reading from pipe");
+        exit(4);
+    }
+    
+    if(result > 0)
+    {
+        params->pipeStats.reads++;
+    }
+    return result;
+}
+
+/* Closes the writing end of the pipe */
+void pipeClose(ThreadParams *params)
+{
+    if(params->byteRing != NULL)
+    {
+        byteRingClose(params->byteRing);
+    }
+    else
+    {
+        close(params->pipeFile[1]);
+    }
+}
+
+/* Writes the frames waiting in the batch to the pipe */
+void pipeFlush(ThreadParams *params, PipeBatch *batch)
+{
+    if(batch->used > 0)
+    {
+        pipeWrite(params, batch->data, batch->used);
+        batch->used = 0;
+    }
+}
+
+/* Sends the end of file marker for the current pipe mode and flushes the batch */
+void pipeEndJob(ThreadParams *params, PipeBatch *batch)
+{
+    char txtLine[MAX_LINE_SIZE];
+    uint64_t segmentLength = 0;
+    uint32_t length = 0;
+    
+    if(params->zeroCopy)
+    {
+        // A zero length segment ends the spliced body
+        pipeWrite(params, (char *)&segmentLength, sizeof(segmentLength));
+    }
+    else if(params->framed)
+    {
+        // A zero length frame ends the file, real lines are never empty
+        if(batch->used + sizeof(length) > sizeof(batch->data))
+        {
+            pipeFlush(params, batch);
+        }
+        memcpy(batch->data + batch->used, &length, sizeof(length));
+        batch->used += sizeof(length);
+        pipeFlush(params, batch);
+    }
+    else
+    {
+        // An empty fixed size line ends the file
+        txtLine[0] = '\0';
+        pipeWrite(params, txtLine, MAX_LINE_SIZE);
+        
+        // Wait for the last line that was left open by pipeSendLine
+        if(params->lockstep && batch->lineOpen)
+        {
+            timedWait(&(params->stages[STAGE_A].wait), &(params->sem_A_to_B));
+        }
+        batch->lineOpen = 0;
+    }
+}
+
+/* Reads exactly length bytes from the pipe, returns 0 if the pipe is closed first */
+int pipeReadFull(ThreadParams *params, char *buffer, size_t length)
+{
+    size_t result;
+    
+    while(length > 0)
+    {
+        result = pipeRead(params, buffer, length);
+        if(result == 0)
+        {
+            return 0;
+        }
+        
+        buffer += result;
+        length -= result;
+    }
+    
+    return 1;
+}
+
+/* Writes every line of the input file to the pipe */
+void pipeWriteLines(ThreadParams *params, PipeBatch *batch, FILE *readTxt, LineBuffer *line)
+{
+    TimeStat *stat = &(params->stages[STAGE_A].file);
+    uint64_t start;
+    ssize_t length;
+    
+    // Read all lines from input file, whatever their length
+    while(1)
+    {
+        start = timerStart(stat);
+        length = getline(&(line->data), &(line->capacity), readTxt);
+        timerStop(stat, start);
+        if(length <= 0)
+        {
+            break;
+        }
+        
+        pipeSendLine(params, batch, line->data, length);
+    }
+}
+
+/* Writes every line of the mapped input file to the pipe */
+void pipeWriteMapped(ThreadParams *params, PipeBatch *batch, MappedFile *map)
+{
+    const char *line = map->data;
+    const char *end = map->data + map->size;
+    const char *next;
+    
+    while(line < end)
+    {
+        // Find the end of the line, the last line may have no newline
+        next = scanByte(line, end, '\n');
+        next = (next != NULL) ? next + 1 : end;
+        
+        pipeSendLine(params, batch, line, next - line);
+        line = next;
+    }
+}
+
+/* Skips the header and sends the rest of the input file through the pipe in
+ * length-prefixed segments, splicing regular files without copying them */
+void pipeSpliceFile(ThreadParams *params, FILE *readTxt, MappedFile *map, LineBuffer *line)
+{
+    char txtLine[MAX_LINE_SIZE];
+    char buffer[PIPE_BATCH_SIZE];
+    struct stat info;
+    off_t offset = -1;
+    StageStats *stage = &(params->stages[STAGE_A]);
+    uint64_t segmentLength;
+    uint64_t start;
+    size_t count;
+    ssize_t result;
+    ssize_t length;
+    
+    if(map->data != NULL)
+    {
+        // Search the whole mapping for the end of the header
+        offset = findBodyOffset(map->data, map->size);
+    }
+    else
+    {
+        // Find the end of the header once with the normal line reader
+        while(1)
+        {
+            start = timerStart(&(stage->file));
+            length = getline(&(line->data), &(line->capacity), readTxt);
+            timerStop(&(stage->file), start);
+            if(length <= 0)
+            {
+                break;
+            }
+            
+            if(scanString(line->data, line->data + length, END_HEADER, END_HEADER_LENGTH) != NULL)
+            {
+                offset = 0;
+                break;
+            }
+        }
+    }
+    
+    // Without a header flag there is no body to output
+    if(offset < 0)
+    {
+        return;
+    }
+    
+    // Streams have no offset to splice from, so send what stdio reads in segments
+    if(fstat(fileno(readTxt), &info) < 0 || !S_ISREG(info.st_mode))
+    {
+        while(1)
+        {
+            start = timerStart(&(stage->file));
+            count = fread(buffer, 1, sizeof(buffer), readTxt);
+            timerStop(&(stage->file), start);
+            if(count == 0)
+            {
+                break;
+            }
+            
+            stage->bytes += count;
+            segmentLength = count;
+            pipeWrite(params, (char *)&segmentLength, sizeof(segmentLength));
+            pipeWrite(params, buffer, count);
+        }
+        return;
+    }
+    
+    if(map->data == NULL)
+    {
+        offset = ftello(readTxt);
+    }
+    segmentLength = info.st_size - offset;
+    
+    if(params->logLevel >= LOG_TRACE)
+    {
+        snprintf(txtLine, sizeof(txtLine), "%lld", (long long)offset);
+        outputVar("THREADA: Splicing body from byte: ", 'M', txtLine);
+    }
+    
+    // Announce the body length then move the body into the pipe without
+    // copying it through user memory
+    pipeWrite(params, (char *)&segmentLength, sizeof(segmentLength));
+    stage->bytes += segmentLength;
+    while(segmentLength > 0)
+    {
+        start = timerStart(&(stage->pipe));
+        result = spliceChunk(fileno(readTxt), &offset, params->pipeFile[1], segmentLength);
+        timerStop(&(stage->pipe), start);
+        if(result <= 0)
+        {
+            perror("Error splicing to pipe");
+            exit(2);
+        }
+        
+        params->pipeStats.writes++;
+        params->pipeStats.pipeBytes += result;
+        segmentLength -= result;
+    }
+}
+
+/* Splices each segment of the body from the pipe into the output file */
+void pipeSpliceOutput(ThreadParams *params)
+{
+    StageStats *stage = &(params->stages[STAGE_B]);
+    uint64_t segmentLength;
+    uint64_t start;
+    ssize_t result;
+    int writeFd = params->writeFd;
+    
+    while(1)
+    {
+        if(!pipeReadFull(params, (char *)&segmentLength, sizeof(segmentLength)))
+        {
+            fprintf(stderr, "Error reading from pipe: unexpected end of data\n");
+            exit(4);
+        }
+        
+        // A zero length segment ends the file
+        if(segmentLength == 0)
+        {
+            break;
+        }
+        
+        while(segmentLength > 0)
+        {
+            start = timerStart(&(stage->pipe));
+            result = spliceChunk(params->pipeFile[0], NULL, writeFd, segmentLength);
+            timerStop(&(stage->pipe), start);
+            if(result <= 0)
+            {
+                perror("Error splicing from pipe");
+                exit(4);
+            }
+            
+            stage->bytes += result;            
+            params->pipeStats.reads++;
+            segmentLength -= result;
+        }
+    }
+}
+
+
+/* Copies the body of the mapped input file into the output file with a pool of workers */
+int parallelCopy(ThreadParams *params, MappedFile *map)
+{
+    CopyRange *ranges;
+    struct stat info;
+    off_t base, bodyOffset, bodySize, start, end;
+    const char *newline;
+    char value[64];
+    uint64_t copyStart;
+    int flags = fcntl(params->writeFd, F_GETFL), i;
+    
+    // Workers need a seekable output file that is not appended to, to write their ranges out of order
+    if(fstat(params->writeFd, &info) < 0 || !S_ISREG(info.st_mode) || flags < 0 || (flags & O_APPEND))
+    {
+        return -1;
+    }
+    
+    // The body goes at the current offset, after what earlier jobs wrote to a shared output
+    base = lseek(params->writeFd, 0, SEEK_CUR);
+    if(base < 0)
+    {
+        return -1;
+    }
+    
+    // Without a header flag there is no body to output
+    bodyOffset = findBodyOffset(map->data, map->size);
+    if(bodyOffset < 0)
+    {
+        return 0;
+    }
+    bodySize = map->size - bodyOffset;
+    
+    // Size the output up front so every worker can write anywhere in it, never cutting it shorter
+    if(info.st_size < base + bodySize && ftruncate(params->writeFd, base + bodySize) < 0)
+    {
+        perror("Error sizing output file");
+        exit(5);
+    }
+    
+    ranges = malloc(params->workers * sizeof(CopyRange));
+    if(ranges == NULL)
+    {
+        perror("Error allocating copy ranges");
+        exit(5);
+    }
+    
+    // Split the body evenly, moving each split forward to the next line,
+    // the whole copy is timed as file I/O of ThreadA
+    copyStart = timerStart(&(params->stages[STAGE_A].file));
+    start = bodyOffset;
+    for(i = 0; i < params->workers; i++)
+    {
+        end = bodyOffset + bodySize * (i + 1) / params->workers;
+        if(end < start)
+        {
+            end = start;
+        }
+        else if(end < (off_t)map->size)
+        {
+            newline = scanByte(map->data + end, map->data + map->size, '\n');
+            end = (newline != NULL) ? newline + 1 - map->data : (off_t)map->size;
+        }
+        
+        ranges[i].data = map->data;
+        ranges[i].start = start;
+        ranges[i].end = end;
+        ranges[i].outputOffset = base + start - bodyOffset;
+        ranges[i].writeFd = params->writeFd;
+        start = end;
+        
+        if(pthread_create(&(ranges[i].tid), NULL, copyWorker, (void*)(&ranges[i])) != 0)
+        {
+            perror("Error creating threads: ");
+            exit(-1);
+        }
+    }
+    
+    // Wait on workers to finish
+    for(i = 0; i < params->workers; i++)
+    {
+        pthread_join(ranges[i].tid, NULL);
+    }
+    free(ranges);
+    timerStop(&(params->stages[STAGE_A].file), copyStart);
+    
+    // Move the file offset past the body, so a shared stdout stays consistent across manifest jobs
+    if(lseek(params->writeFd, base + bodySize, SEEK_SET) < 0)
+    {
+        perror("Error seeking output file");
+        exit(5);
+    }
+    params->stages[STAGE_A].bytes += bodySize;
+    
+    if(params->logLevel >= LOG_TRACE)
+    {
+        snprintf(value, sizeof(value), "%lld bytes with %d workers", (long long)bodySize, params->workers);
+        outputVar("THREADA: Copied body in parallel: ", 'M', value);
+    }
+    
+    return 0;
+}
+
+/* This thread copies one range of the body into the output file */
+void *copyWorker(void *range)
+{
+    CopyRange *copyRange = (CopyRange *)(range);
+    off_t offset = copyRange->start;
+    size_t length;
+    ssize_t result;
+    
+    // Write in bounded chunks so the page cache can keep up with the readahead
+    while(offset < copyRange->end)
+    {
+        length = copyRange->end - offset;
+        if(length > COPY_CHUNK_SIZE)
+        {
+            length = COPY_CHUNK_SIZE;
+        }
+        
+        result = pwrite(copyRange->writeFd, copyRange->data + offset, length,
+            copyRange->outputOffset + (offset - copyRange->start));
+        if(result < 0)
+        {
+            perror("Error writing to output file");
+            exit(5);
+        }
+        offset += result;
+    }
+    
+    return NULL;
+}
+
+/* Moves up to length bytes between two descriptors with splice, copying when
+ * splice is unsupported */
+ssize_t spliceChunk(int fdIn, off_t *offsetIn, int fdOut, size_t length)
+{
+    char buffer[PIPE_BATCH_SIZE];
+    ssize_t result, written, total;
+    
+    if(length > SPLICE_CHUNK_SIZE)
+    {
+        length = SPLICE_CHUNK_SIZE;
+    }
+    
+    result = splice(fdIn, offsetIn, fdOut, NULL, length, SPLICE_F_MOVE | SPLICE_F_MORE);
+    if(result >= 0 || (errno != EINVAL && errno != ENOSYS))
+    {
+        return result;
+    }
+    
+    // Fall back to a plain copy for descriptors that cannot be spliced
+    if(length > sizeof(buffer))
+    {
+        length = sizeof(buffer);
+    }
+    
+    if(offsetIn != NULL)
+    {
+        result = pread(fdIn, buffer, length, *offsetIn);
+    }
+    else
+    {
+        result = read(fdIn, buffer, length);
+    }
+    
+    for(total = 0; total < result; total += written)
+    {
+        written = write(fdOut, buffer + total, result - total);
+        if(written < 0)
+        {
+            return -1;
+        }
+    }
+    
+    if(offsetIn != NULL && result > 0)
+    {
+        *offsetIn += result;
+    }
+    
+    return result;
+}
+
+/* Sets up an io_uring with registered buffers, returns -1 if the kernel has none */
+int uringInit(Uring *ring)
+{
+    struct io_uring_params setup;
+    struct iovec iov[URING_DEPTH];
+    char *sq, *cq;
+    int i;
+    
+    memset(&setup, 0, sizeof(setup));
+    ring->fd = syscall(__NR_io_uring_setup, URING_DEPTH, &setup);
+    if(ring->fd < 0)
+    {
+        return -1;
+    }
+    
+    // Map the submission and completion rings, which share one mapping on newer kernels
+    ring->sqRingSize = setup.sq_off.array + setup.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = setup.cq_off.cqes + setup.cq_entries * sizeof(struct io_uring_cqe);
+    if(setup.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if(ring->cqRingSize > ring->sqRingSize)
+        {
+            ring->sqRingSize = ring->cqRingSize;
+        }
+        ring->cqRingSize = ring->sqRingSize;
+    }
+    
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring->fd, IORING_OFF_SQ_RING);
+    ring->cqRing = ring->sqRing;
+    if(ring->sqRing != MAP_FAILED && !(setup.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring->fd, IORING_OFF_CQ_RING);
+    }
+    ring->sqesSize = setup.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring->fd, IORING_OFF_SQES);
+    if(ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        perror("Error mapping io_uring");
+        exit(1);
+    }
+    
+    sq = ring->sqRing;
+    cq = ring->cqRing;
+    ring->sqTail = (unsigned *)(sq + setup.sq_off.tail);
+    ring->sqMask = (unsigned *)(sq + setup.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(sq + setup.sq_off.array);
+    ring->cqHead = (unsigned *)(cq + setup.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + setup.cq_off.tail);
+    ring->cqMask = (unsigned *)(cq + setup.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + setup.cq_off.cqes);
+    
+    // Page aligned buffers registered once so the kernel does not map them for every request
+    if(posix_memalign((void **)&(ring->buffers), 4096, (size_t)URING_DEPTH * URING_BUFFER_SIZE) != 0)
+    {
+        perror("Error allocating io_uring buffers");
+        exit(1);
+    }
+    for(i = 0; i < URING_DEPTH; i++)
+    {
+        iov[i].iov_base = ring->buffers + (size_t)i * URING_BUFFER_SIZE;
+        iov[i].iov_len = URING_BUFFER_SIZE;
+        ring->busy[i] = 0;
+    }
+    ring->fixedBuffers = (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, iov, URING_DEPTH) == 0);
+    ring->fixedFile = 0;
+    ring->fileFd = -1;
+    
+    return 0;
+}
+
+/* Frees an io_uring set up with uringInit */
+void uringDestroy(Uring *ring)
+{
+    if(ring->fd < 0)
+    {
+        return;
+    }
+    
+    munmap(ring->sqes, ring->sqesSize);
+    if(ring->cqRing != ring->sqRing)
+    {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    munmap(ring->sqRing, ring->sqRingSize);
+    close(ring->fd);
+    free(ring->buffers);
+    ring->fd = -1;
+}
+
+/* Registers a regular file for reads or writes from its current offset,
+ * returns -1 if the file cannot be used */
+int uringOpenFile(Uring *ring, int fd)
+{
+    struct stat info;
+    int flags = fcntl(fd, F_GETFL);
+    
+    // Requests at explicit offsets need a seekable file that is not appended to
+    if(fstat(fd, &info) < 0 || !S_ISREG(info.st_mode) || flags < 0 || (flags & O_APPEND))
+    {
+        return -1;
+    }
+    
+    ring->offset = lseek(fd, 0, SEEK_CUR);
+    if(ring->offset < 0)
+    {
+        return -1;
+    }
+    
+    ring->fileFd = fd;
+    ring->fixedFile = (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_FILES, &fd, 1) == 0);
+    ring->current = 0;
+    ring->lengths[0] = 0;
+    
+    return 0;
+}
+
+/* Moves the file offset past the data read or written and releases the file */
+void uringCloseFile(Uring *ring)
+{
+    lseek(ring->fileFd, ring->offset, SEEK_SET);
+    if(ring->fixedFile)
+    {
+        syscall(__NR_io_uring_register, ring->fd, IORING_UNREGISTER_FILES, NULL, 0);
+        ring->fixedFile = 0;
+    }
+    ring->fileFd = -1;
+}
+
+/* Submits a read or write of length bytes between a buffer and the file */
+void uringQueue(Uring *ring, int write, int index, size_t length, off_t offset)
+{
+    unsigned tail = *(ring->sqTail);
+    unsigned slot = tail & *(ring->sqMask);
+    struct io_uring_sqe *sqe = &(ring->sqes[slot]);
+    
+    memset(sqe, 0, sizeof(*sqe));
+    if(ring->fixedBuffers)
+    {
+        sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = index;
+    }
+    else
+    {
+        sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    if(ring->fixedFile)
+    {
+        sqe->fd = 0;
+        sqe->flags = IOSQE_FIXED_FILE;
+    }
+    else
+    {
+        sqe->fd = ring->fileFd;
+    }
+    sqe->addr = (uintptr_t)(ring->buffers + (size_t)index * URING_BUFFER_SIZE);
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = index;
+    
+    ring->offsets[index] = offset;
+    ring->lengths[index] = length;
+    ring->busy[index] = 1;
+    
+    // Publish the entry before the new tail, then hand it to the kernel
+    ring->sqArray[slot] = slot;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    while(syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0) < 0)
+    {
+        if(errno != EINTR && errno != EAGAIN)
+        {
+            perror("Error submitting to io_uring");
+            exit(1);
+        }
+    }
+}
+
+/* Waits for a read or write to complete, returns its result and buffer */
+int uringWait(Uring *ring, int *index)
+{
+    unsigned head = *(ring->cqHead);
+    struct io_uring_cqe *cqe;
+    int result;
+    
+    while(head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+    {
+        if(syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+        {
+            perror("Error waiting for io_uring");
+            exit(1);
+        }
+    }
+    
+    cqe = &(ring->cqes[head & *(ring->cqMask)]);
+    *index = cqe->user_data;
+    result = cqe->res;
+    __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+    
+    ring->busy[*index] = 0;
+    return result;
+}
+
+/* Copies data into the current buffer, writing each buffer once it is full */
+void uringWrite(Uring *ring, const char *data, size_t length)
+{
+    char *buffer;
+    size_t count;
+    
+    while(length > 0)
+    {
+        buffer = ring->buffers + (size_t)ring->current * URING_BUFFER_SIZE;
+        count = URING_BUFFER_SIZE - ring->lengths[ring->current];
+        if(count > length)
+        {
+            count = length;
+        }
+        
+        memcpy(buffer + ring->lengths[ring->current], data, count);
+        ring->lengths[ring->current] += count;
+        data += count;
+        length -= count;
+        
+        // Write the full buffer and move on to the next, waiting for it if it is still in flight
+        if(ring->lengths[ring->current] == URING_BUFFER_SIZE)
+        {
+            uringQueue(ring, 1, ring->current, URING_BUFFER_SIZE, ring->offset);
+            ring->offset += URING_BUFFER_SIZE;
+            ring->current = (ring->current + 1) % URING_DEPTH;
+            while(ring->busy[ring->current])
+            {
+                uringFinishWrite(ring);
+            }
+            ring->lengths[ring->current] = 0;
+        }
+    }
+}
+
+/* Writes the current buffer and waits for every write to complete */
+void uringFlush(Uring *ring)
+{
+    int i;
+    
+    if(ring->lengths[ring->current] > 0)
+    {
+        uringQueue(ring, 1, ring->current, ring->lengths[ring->current], ring->offset);
+        ring->offset += ring->lengths[ring->current];
+    }
+    
+    for(i = 0; i < URING_DEPTH; i++)
+    {
+        while(ring->busy[i])
+        {
+            uringFinishWrite(ring);
+        }
+    }
+    
+    ring->current = 0;
+    ring->lengths[0] = 0;
+}
+
+/* Waits for the write from a buffer and finishes it if it was short */
+void uringFinishWrite(Uring *ring)
+{
+    ssize_t result, written;
+    char *buffer;
+    int index;
+    
+    result = uringWait(ring, &index);
+    if(result < 0)
+    {
+        errno = -result;
+        perror("Error writing to file");
+        exit(5);
+    }
+    
+    // A short write is rare on a regular file, so finish it without the ring
+    buffer = ring->buffers + (size_t)index * URING_BUFFER_SIZE;
+    while((size_t)result < ring->lengths[index])
+    {
+        written = pwrite(ring->fileFd, buffer + result, ring->lengths[index] - result,
+            ring->offsets[index] + result);
+        if(written <= 0)
+        {
+            perror("Error writing to file");
+            exit(5);
+        }
+        result += written;
+    }
+}
+
+/* Reads the input file through io_uring and writes every line to the pipe,
+ * returns -1 if the file cannot be read this way */
+int pipeWriteUring(ThreadParams *params, PipeBatch *batch, Uring *ring, int fd, LineBuffer *line)
+{
+    TimeStat *stat = &(params->stages[STAGE_A].file);
+    struct stat info;
+    off_t end, next;
+    unsigned long queued = 0, consumed = 0;
+    const char *data, *dataEnd, *newline;
+    uint64_t start;
+    size_t length;
+    int index, result;
+    
+    if(fstat(fd, &info) < 0 || uringOpenFile(ring, fd) < 0)
+    {
+        return -1;
+    }
+    end = info.st_size;
+    next = ring->offset;
+    
+    // Fill every buffer with a read of the next block of the file
+    for(index = 0; index < URING_DEPTH && next < end; index++)
+    {
+        length = (end - next < URING_BUFFER_SIZE) ? end - next : URING_BUFFER_SIZE;
+        uringQueue(ring, 0, index, length, next);
+        next += length;
+        queued++;
+    }
+    
+    // Use the blocks in file order as their reads complete
+    line->length = 0;
+    while(consumed < queued)
+    {
+        index = consumed % URING_DEPTH;
+        start = timerStart(stat);
+        while(ring->busy[index])
+        {
+            result = uringWait(ring, &index);
+            if(result < 0)
+            {
+                errno = -result;
+                perror("Error reading from file");
+                exit(3);
+            }
+            
+            // A short read means the file ended sooner than its size said
+            if((size_t)result < ring->lengths[index])
+            {
+                ring->lengths[index] = result;
+                if(ring->offsets[index] + result < end)
+                {
+                    end = ring->offsets[index] + result;
+                }
+            }
+            index = consumed % URING_DEPTH;
+        }
+        timerStop(stat, start);
+        
+        data = ring->buffers + (size_t)index * URING_BUFFER_SIZE;
+        dataEnd = data + ((ring->offsets[index] < end) ? ring->lengths[index] : 0);
+        while(data < dataEnd)
+        {
+            // A line that runs past the block is carried into the line buffer
+            newline = scanByte(data, dataEnd, '\n');
+            length = (newline != NULL) ? newline + 1 - data : dataEnd - data;
+            if(newline == NULL || line->length > 0)
+            {
+                lineReserve(line, line->length + length);
+                memcpy(line->data + line->length, data, length);
+                line->length += length;
+            }
+            if(newline != NULL)
+            {
+                if(line->length > 0)
+                {
+                    pipeSendLine(params, batch, line->data, line->length);
+                    line->length = 0;
+                }
+                else
+                {
+                    pipeSendLine(params, batch, data, length);
+                }
+            }
+            data += length;
+        }
+        consumed++;
+        
+        // Reuse the buffer for the next block of the file
+        if(next < end)
+        {
+            length = (end - next < URING_BUFFER_SIZE) ? end - next : URING_BUFFER_SIZE;
+            uringQueue(ring, 0, index, length, next);
+            next += length;
+            queued++;
+        }
+    }
+    
+    // The last line may have no newline
+    if(line->length > 0)
+    {
+        pipeSendLine(params, batch, line->data, line->length);
+        line->length = 0;
+    }
+    
+    ring->offset = end;
+    uringCloseFile(ring);
+    return 0;
+}
+
+/* Allocates the aligned buffer of a writer */
+void writerInit(Writer *writer)
+{
+    if(posix_memalign((void **)&(writer->buffer), DIRECT_ALIGNMENT, WRITER_BUFFER_SIZE) != 0)
+    {
+        perror("Error allocating output buffer");
+        exit(1);
+    }
+    writer->used = 0;
+    writer->fd = -1;
+}
+
+/* Starts writing to a file with a durability policy, returns -1 if O_DIRECT
+ * was asked for but the file cannot use it */
+int writerOpen(Writer *writer, int fd, int syncMode, unsigned long long syncEvery, int direct)
+{
+    struct stat info;
+    off_t offset;
+    
+    writer->fd = fd;
+    writer->used = 0;
+    writer->start = 0;
+    writer->written = 0;
+    writer->direct = 0;
+    writer->regular = (fstat(fd, &info) == 0 && S_ISREG(info.st_mode));
+    writer->flags = fcntl(fd, F_GETFL);
+    writer->syncMode = syncMode;
+    writer->syncEvery = syncEvery;
+    writer->unsynced = 0;
+    
+    if(!direct)
+    {
+        return 0;
+    }
+    
+    // O_DIRECT needs a regular file that is not appended to, positioned on a block boundary
+    offset = lseek(fd, 0, SEEK_CUR);
+    if(!writer->regular || writer->flags < 0 || (writer->flags & O_APPEND) || offset < 0
+        || offset % DIRECT_ALIGNMENT != 0 || fcntl(fd, F_SETFL, writer->flags | O_DIRECT) < 0)
+    {
+        return -1;
+    }
+    
+    writer->start = offset;
+    writer->direct = 1;
+    return 0;
+}
+
+/* Adds data to the buffer, writing the buffer once the data no longer fits */
+void writerWrite(Writer *writer, const char *data, size_t length)
+{
+    size_t count;
+    
+    if(writer->used + length <= WRITER_BUFFER_SIZE)
+    {
+        memcpy(writer->buffer + writer->used, data, length);
+        writer->used += length;
+        return;
+    }
+    
+    // Without O_DIRECT the line is written along with the buffer instead of being copied
+    if(!writer->direct)
+    {
+        writerFlush(writer, data, length);
+        return;
+    }
+    
+    // O_DIRECT only writes whole aligned buffers
+    while(length > 0)
+    {
+        count = WRITER_BUFFER_SIZE - writer->used;
+        if(count > length)
+        {
+            count = length;
+        }
+        
+        memcpy(writer->buffer + writer->used, data, count);
+        writer->used += count;
+        data += count;
+        length -= count;
+        
+        if(writer->used == WRITER_BUFFER_SIZE)
+        {
+            writerFlush(writer, NULL, 0);
+        }
+    }
+}
+
+/* Writes the buffer followed by an optional extra block of data */
+void writerFlush(Writer *writer, const char *data, size_t length)
+{
+    struct iovec iov[2];
+    int count = 0, first = 0;
+    ssize_t result;
+    
+    iov[0].iov_base = writer->buffer;
+    iov[0].iov_len = writer->used;
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = length;
+    count = (length > 0) ? 2 : 1;
+    
+    while(first < count)
+    {
+        result = writev(writer->fd, iov + first, count - first);
+        if(result < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("Error writing to file");
+            exit(5);
+        }
+        
+        writer->written += result;
+        writer->unsynced += result;
+        
+        // Step over what was written and retry the rest
+        while(first < count && (size_t)result >= iov[first].iov_len)
+        {
+            result -= iov[first].iov_len;
+            first++;
+        }
+        if(first < count)
+        {
+            iov[first].iov_base = (char *)iov[first].iov_base + result;
+            iov[first].iov_len -= result;
+        }
+    }
+    writer->used = 0;
+    
+    // Push the data to the device every syncEvery bytes
+    if(writer->syncMode == SYNC_DATA && writer->regular && writer->unsynced >= writer->syncEvery)
+    {
+        syncFile(writer->fd, SYNC_DATA);
+        writer->unsynced = 0;
+    }
+}
+
+/* Writes what is left, trims the O_DIRECT padding and syncs the file */
+void writerClose(Writer *writer)
+{
+    size_t padded = (writer->used + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT;
+    off_t length;
+    
+    if(writer->direct && writer->used > 0)
+    {
+        // Write the last block padded with zeros, then cut the file back to the real length
+        length = writer->start + writer->written + writer->used;
+        memset(writer->buffer + writer->used, 0, padded - writer->used);
+        writer->used = padded;
+        writerFlush(writer, NULL, 0);
+        if(ftruncate(writer->fd, length) < 0 || lseek(writer->fd, length, SEEK_SET) < 0)
+        {
+            perror("Error trimming output file");
+            exit(5);
+        }
+    }
+    else if(writer->used > 0)
+    {
+        writerFlush(writer, NULL, 0);
+    }
+    
+    // Leave the descriptor as it was found, it may be shared with stdout
+    if(writer->direct)
+    {
+        fcntl(writer->fd, F_SETFL, writer->flags);
+    }
+    
+    if(writer->regular)
+    {
+        syncFile(writer->fd, writer->syncMode);
+    }
+    writer->fd = -1;
+}
+
+/* Makes a file durable as its sync mode asks */
+void syncFile(int fd, int syncMode)
+{
+    int result = 0;
+    
+    if(syncMode == SYNC_DATA)
+    {
+        result = fdatasync(fd);
+    }
+    else if(syncMode == SYNC_CLOSE)
+    {
+        result = fsync(fd);
+    }
+    
+    // Pipes and terminals have nothing to sync
+    if(result < 0 && errno != EINVAL)
+    {
+        perror("Error syncing output file");
+        exit(5);
+    }
+}
+
+/* Reads a -y setting, returns -1 if it is not none, close or a number of MB */
+int parseSync(const char *text, int *syncMode, unsigned long long *syncEvery)
+{
+    char *end;
+    unsigned long long megabytes;
+    
+    if(strcmp(text, "none") == 0)
+    {
+        *syncMode = SYNC_NONE;
+        return 0;
+    }
+    if(strcmp(text, "close") == 0)
+    {
+        *syncMode = SYNC_CLOSE;
+        return 0;
+    }
+    
+    megabytes = strtoull(text, &end, 10);
+    if(*text == '\0' || *end != '\0' || megabytes == 0)
+    {
+        return -1;
+    }
+    
+    *syncMode = SYNC_DATA;
+    *syncEvery = megabytes * 1024 * 1024;
+    return 0;
+}
+
+/* Finds the compression of a file from its magic bytes or its name */
+int codecType(FILE *file, const char *filename, int compress, int inputCodec)
+{
+    unsigned char magic[4];
+    size_t length = strlen(filename);
+    ssize_t result = 0;
+    int stream;
+    
+    // Inputs that can be read ahead are known by their first bytes
+    if(!compress)
+    {
+        result = pread(fileno(file), magic, sizeof(magic), 0);
+    }
+    stream = (result < 0 && errno == ESPIPE);
+    if(result == sizeof(magic))
+    {
+        if(magic[0] == 0x1F && magic[1] == 0x8B)
+        {
+            return CODEC_GZIP;
+        }
+        if(magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD)
+        {
+            return CODEC_ZSTD;
+        }
+        return CODEC_NONE;
+    }
+    
+    if(length > 3 && strcmp(filename + length - 3, ".gz") == 0)
+    {
+        return CODEC_GZIP;
+    }
+    if(length > 4 && strcmp(filename + length - 4, ".zst") == 0)
+    {
+        return CODEC_ZSTD;
+    }
+    
+    // Nothing can be seen of a pipe such as stdin without taking it, so -Z says what it holds
+    return stream ? inputCodec : CODEC_NONE;
+}
+
+/* Puts a codec thread between a compressed file and the pipeline, replacing
+ * the file with the plain end of a pipe */
+void codecStart(Codec *codec, FILE **file, const char *filename, int compress, int syncMode, int level,
+    int inputCodec)
+{
+    int pipeFile[2];
+    
+    codec->type = codecType(*file, filename, compress, inputCodec);
+    if(codec->type == CODEC_NONE)
+    {
+        return;
+    }
+    
+#ifndef HAVE_ZSTD
+    if(codec->type == CODEC_ZSTD)
+    {
+        fprintf(stderr, "Error: %s is zstd but zstd support was not compiled in\n", filename);
+        exit(1);
+    }
+#endif
+    
+    codec->compress = compress;
+    codec->level = level;
+    codec->syncMode = syncMode;
+    codec->file = *file;
+    codec->plainBytes = 0;
+    codec->fileBytes = 0;
+    codec->input = malloc(CODEC_BUFFER_SIZE);
+    codec->output = malloc(CODEC_BUFFER_SIZE);
+    if(codec->input == NULL || codec->output == NULL)
+    {
+        perror("Error allocating codec buffers");
+        exit(1);
+    }
+    
+    if(pipe(pipeFile) < 0)
+    {
+        perror("Error creating codec pipe");
+        exit(1);
+    }
+    
+    // The pipeline gets the plain end of the pipe in place of the file
+    codec->pipeFd = compress ? pipeFile[0] : pipeFile[1];
+    *file = fdopen(compress ? pipeFile[1] : pipeFile[0], compress ? "w" : "r");
+    if(*file == NULL)
+    {
+        perror("Error opening codec pipe");
+        exit(1);
+    }
+    
+    if(pthread_create(&(codec->tid), NULL, codecThread, (void*)codec) != 0)
+    {
+        perror("Error creating threads: ");
+        exit(-1);
+    }
+}
+
+/* Waits for the codec thread to finish its file */
+void codecFinish(Codec *codec, int logLevel)
+{
+    char value[64];
+    
+    if(codec->type == CODEC_NONE)
+    {
+        return;
+    }
+    
+    pthread_join(codec->tid, NULL);
+    free(codec->input);
+    free(codec->output);
+    
+    if(logLevel >= LOG_TRACE)
+    {
+        snprintf(value, sizeof(value), "%llu bytes from %llu bytes",
+            codec->compress ? codec->fileBytes : codec->plainBytes,
+            codec->compress ? codec->plainBytes : codec->fileBytes);
+        outputVar(codec->compress ? "CODEC: Compressed output: " : "CODEC: Decompressed input: ", 'C', value);
+    }
+}
+
+/* This thread runs the codec of one file */
+void *codecThread(void *codec)
+{
+    Codec *fileCodec = (Codec *)(codec);
+    sigset_t signals;
+    
+    // A pipeline that stops reading early shows up as EPIPE rather than a signal
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    
+    if(fileCodec->type == CODEC_GZIP)
+    {
+        if(fileCodec->compress)
+        {
+            gzipCompress(fileCodec);
+        }
+        else
+        {
+            gzipDecompress(fileCodec);
+        }
+    }
+#ifdef HAVE_ZSTD
+    else if(fileCodec->compress)
+    {
+        zstdCompress(fileCodec);
+    }
+    else
+    {
+        zstdDecompress(fileCodec);
+    }
+#endif
+    
+    // A compressed output is only durable once the codec has written all of it
+    if(fileCodec->compress)
+    {
+        syncFile(fileno(fileCodec->file), fileCodec->syncMode);
+    }
+    close(fileCodec->pipeFd);
+    fclose(fileCodec->file);
+    
+    return NULL;
+}
+
+/* Reads up to a buffer of data, returns 0 at the end */
+size_t codecRead(int fd, char *buffer, size_t size, const char *message)
+{
+    ssize_t result;
+    
+    do
+    {
+        result = read(fd, buffer, size);
+    }
+    while(result < 0 && errno == EINTR);
+    
+    if(result < 0)
+    {
+        perror(message);
+        exit(3);
+    }
+    return result;
+}
+
+/* Writes all the data, returns -1 if the pipeline has stopped reading */
+int codecWrite(int fd, const char *data, size_t length, const char *message)
+{
+    ssize_t result;
+    
+    while(length > 0)
+    {
+        result = write(fd, data, length);
+        if(result < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if(errno == EPIPE)
+            {
+                return -1;
+            }
+            perror(message);
+            exit(5);
+        }
+        data += result;
+        length -= result;
+    }
+    return 0;
+}
+
+/* Decompresses gzip or zlib data, including several gzip members in a row */
+void gzipDecompress(Codec *codec)
+{
+    z_stream stream;
+    size_t count;
+    int result = Z_OK;
+    
+    memset(&stream, 0, sizeof(stream));
+    if(inflateInit2(&stream, 15 + 32) != Z_OK)
+    {
+        fprintf(stderr, "Error starting gzip decompression\n");
+        exit(3);
+    }
+    
+    while((count = codecRead(fileno(codec->file), codec->input, CODEC_BUFFER_SIZE, "Error reading from file")) > 0)
+    {
+        codec->fileBytes += count;
+        stream.next_in = (Bytef *)codec->input;
+        stream.avail_in = count;
+        
+        while(stream.avail_in > 0)
+        {
+            // Another member may follow the end of the last one
+            if(result == Z_STREAM_END)
+            {
+                inflateReset(&stream);
+            }
+            
+            stream.next_out = (Bytef *)codec->output;
+            stream.avail_out = CODEC_BUFFER_SIZE;
+            result = inflate(&stream, Z_NO_FLUSH);
+            if(result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+            {
+                fprintf(stderr, "Error decompressing file: %s\n", stream.msg ? stream.msg : "corrupt data");
+                exit(3);
+            }
+            
+            count = CODEC_BUFFER_SIZE - stream.avail_out;
+            codec->plainBytes += count;
+            if(codecWrite(codec->pipeFd, codec->output, count, "Error writing to codec pipe") < 0)
+            {
+                inflateEnd(&stream);
+                return;
+            }
+        }
+    }
+    
+    if(result != Z_STREAM_END)
+    {
+        fprintf(stderr, "Error decompressing file: unexpected end of data\n");
+        exit(3);
+    }
+    inflateEnd(&stream);
+}
+
+/* Compresses plain data into a gzip file */
+void gzipCompress(Codec *codec)
+{
+    z_stream stream;
+    size_t count;
+    int flush = Z_NO_FLUSH;
+    
+    memset(&stream, 0, sizeof(stream));
+    if(deflateInit2(&stream, codec->level < 0 ? Z_DEFAULT_COMPRESSION : (codec->level > 9 ? 9 : codec->level),
+        Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        fprintf(stderr, "Error starting gzip compression\n");
+        exit(5);
+    }
+    
+    while(flush != Z_FINISH)
+    {
+        count = codecRead(codec->pipeFd, codec->input, CODEC_BUFFER_SIZE, "Error reading from codec pipe");
+        codec->plainBytes += count;
+        flush = (count == 0) ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in = (Bytef *)codec->input;
+        stream.avail_in = count;
+        
+        // Keep deflating until the input is used up, or the stream is ended
+        do
+        {
+            stream.next_out = (Bytef *)codec->output;
+            stream.avail_out = CODEC_BUFFER_SIZE;
+            deflate(&stream, flush);
+            count = CODEC_BUFFER_SIZE - stream.avail_out;
+            codec->fileBytes += count;
+            codecWrite(fileno(codec->file), codec->output, count, "Error writing to file");
+        }
+        while(stream.avail_out == 0);
+    }
+    deflateEnd(&stream);
+}
+
+#ifdef HAVE_ZSTD
+/* Decompresses zstd data, including several frames in a row */
+void zstdDecompress(Codec *codec)
+{
+    ZSTD_DStream *stream = ZSTD_createDStream();
+    ZSTD_inBuffer in;
+    ZSTD_outBuffer out;
+    size_t count, result = 0;
+    
+    if(stream == NULL)
+    {
+        fprintf(stderr, "Error starting zstd decompression\n");
+        exit(3);
+    }
+    
+    while((count = codecRead(fileno(codec->file), codec->input, CODEC_BUFFER_SIZE, "Error reading from file")) > 0)
+    {
+        codec->fileBytes += count;
+        in.src = codec->input;
+        in.size = count;
+        in.pos = 0;
+        
+        // A full output buffer may leave more data inside the decoder
+        do
+        {
+            out.dst = codec->output;
+            out.size = CODEC_BUFFER_SIZE;
+            out.pos = 0;
+            result = ZSTD_decompressStream(stream, &out, &in);
+            if(ZSTD_isError(result))
+            {
+                fprintf(stderr, "Error decompressing file: %s\n", ZSTD_getErrorName(result));
+                exit(3);
+            }
+            
+            codec->plainBytes += out.pos;
+            if(codecWrite(codec->pipeFd, codec->output, out.pos, "Error writing to codec pipe") < 0)
+            {
+                ZSTD_freeDStream(stream);
+                return;
+            }
+        }
+        while(in.pos < in.size || out.pos == out.size);
+    }
+    
+    if(result != 0)
+    {
+        fprintf(stderr, "Error decompressing file: unexpected end of data\n");
+        exit(3);
+    }
+    ZSTD_freeDStream(stream);
+}
+
+/* Compresses plain data into a zstd file */
+void zstdCompress(Codec *codec)
+{
+    ZSTD_CCtx *stream = ZSTD_createCCtx();
+    ZSTD_inBuffer in;
+    ZSTD_outBuffer out;
+    ZSTD_EndDirective mode = ZSTD_e_continue;
+    size_t count, remaining;
+    
+    if(stream == NULL)
+    {
+        fprintf(stderr, "Error starting zstd compression\n");
+        exit(5);
+    }
+    ZSTD_CCtx_setParameter(stream, ZSTD_c_compressionLevel, codec->level < 0 ? ZSTD_CLEVEL_DEFAULT : codec->level);
+    
+    while(mode != ZSTD_e_end)
+    {
+        count = codecRead(codec->pipeFd, codec->input, CODEC_BUFFER_SIZE, "Error reading from codec pipe");
+        codec->plainBytes += count;
+        mode = (count == 0) ? ZSTD_e_end : ZSTD_e_continue;
+        in.src = codec->input;
+        in.size = count;
+        in.pos = 0;
+        
+        // Keep compressing until the input is used up, or the frame is ended
+        do
+        {
+            out.dst = codec->output;
+            out.size = CODEC_BUFFER_SIZE;
+            out.pos = 0;
+            remaining = ZSTD_compressStream2(stream, &out, &in, mode);
+            if(ZSTD_isError(remaining))
+            {
+                fprintf(stderr, "Error compressing file: %s\n", ZSTD_getErrorName(remaining));
+                exit(5);
+            }
+            
+            codec->fileBytes += out.pos;
+            codecWrite(fileno(codec->file), codec->output, out.pos, "Error writing to file");
+        }
+        while(mode == ZSTD_e_end ? remaining != 0 : in.pos < in.size);
+    }
+    ZSTD_freeCCtx(stream);
+}
+#endif
+
+/* Maps a whole regular file for sequential reading, returns -1 if it cannot be mapped */
+int mapFile(MappedFile *map, int fd)
+{
+    struct stat info;
+    void *data;
+    
+    map->data = NULL;
+    map->size = 0;
+    
+    if(fstat(fd, &info) < 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+    {
+        return -1;
+    }
+    
+    data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED)
+    {
+        return -1;
+    }
+    
+    // Ask the kernel to read ahead aggressively and drop pages behind us
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+    
+    map->data = data;
+    map->size = info.st_size;
+    
+    return 0;
+}
+
+/* Unmaps a file mapped with mapFile */
+void unmapFile(MappedFile *map)
+{
+    if(map->data != NULL)
+    {
+        munmap((void *)map->data, map->size);
+        map->data = NULL;
+    }
+}
+
+/* Returns the offset just after the line holding END_HEADER, or -1 if there is none */
+off_t findBodyOffset(const char *data, size_t size)
+{
+    const char *end = data + size;
+    const char *flag, *newline;
+    
+    flag = scanString(data, end, END_HEADER, END_HEADER_LENGTH);
+    if(flag == NULL)
+    {
+        return -1;
+    }
+    
+    // The body starts on the line after the header flag
+    newline = scanByte(flag, end, '\n');
+    if(newline == NULL)
+    {
+        return -1;
+    }
+    
+    return newline + 1 - data;
+}
+
+/* Returns the first occurrence of a byte in [start, end), or NULL */
+const char *scanByte(const char *start, const char *end, char byte)
+{
+#ifdef HAVE_X86_SIMD
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return scanByteAVX2(start, end, byte);
+    }
+    return scanByteSSE2(start, end, byte);
+#else
+    return scanByteScalar(start, end, byte);
+#endif
+}
+
+/* Returns the first occurrence of a string in [start, end), or NULL */
+const char *scanString(const char *start, const char *end, const char *needle, size_t needleLength)
+{
+#ifdef HAVE_X86_SIMD
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return scanStringAVX2(start, end, needle, needleLength);
+    }
+    return scanStringSSE2(start, end, needle, needleLength);
+#else
+    return scanStringScalar(start, end, needle, needleLength);
+#endif
+}
+
+/* Scalar version of scanByte, also used for short tails */
+const char *scanByteScalar(const char *start, const char *end, char byte)
+{
+    return memchr(start, byte, end - start);
+}
+
+/* Scalar version of scanString, also used for short tails */
+const char *scanStringScalar(const char *start, const char *end, const char *needle, size_t needleLength)
+{
+    return memmem(start, end - start, needle, needleLength);
+}
+
+#ifdef HAVE_X86_SIMD
+/* Compares 16 bytes at a time against the wanted byte */
+const char *scanByteSSE2(const char *start, const char *end, char byte)
+{
+    __m128i wanted = _mm_set1_epi8(byte);
+    int mask;
+    
+    for(; end - start >= 16; start += 16)
+    {
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)start), wanted));
+        if(mask != 0)
+        {
+            return start + __builtin_ctz(mask);
+        }
+    }
+    
+    return scanByteScalar(start, end, byte);
+}
+
+/* Compares 32 bytes at a time against the wanted byte */
+__attribute__((target("avx2")))
+const char *scanByteAVX2(const char *start, const char *end, char byte)
+{
+    __m256i wanted = _mm256_set1_epi8(byte);
+    unsigned int mask;
+    
+    for(; end - start >= 32; start += 32)
+    {
+        mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)start), wanted));
+        if(mask != 0)
+        {
+            return start + __builtin_ctz(mask);
+        }
+    }
+    
+    return scanByteScalar(start, end, byte);
+}
+
+/* Matches the first and last byte of the needle at 16 positions at once
+ * and only compares the whole needle where both match */
+const char *scanStringSSE2(const char *start, const char *end, const char *needle, size_t needleLength)
+{
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[needleLength - 1]);
+    __m128i blockFirst, blockLast;
+    int mask, bit;
+    
+    for(; end - start >= (ptrdiff_t)(16 + needleLength - 1); start += 16)
+    {
+        blockFirst = _mm_loadu_si128((const __m128i *)start);
+        blockLast = _mm_loadu_si128((const __m128i *)(start + needleLength - 1));
+        mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last)));
+        
+        while(mask != 0)
+        {
+            bit = __builtin_ctz(mask);
+            if(memcmp(start + bit + 1, needle + 1, needleLength - 2) == 0)
+            {
+                return start + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    
+    return scanStringScalar(start, end, needle, needleLength);
+}
+
+/* Matches the first and last byte of the needle at 32 positions at once
+ * and only compares the whole needle where both match */
+__attribute__((target("avx2")))
+const char *scanStringAVX2(const char *start, const char *end, const char *needle, size_t needleLength)
+{
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[needleLength - 1]);
+    __m256i blockFirst, blockLast;
+    unsigned int mask;
+    int bit;
+    
+    for(; end - start >= (ptrdiff_t)(32 + needleLength - 1); start += 32)
+    {
+        blockFirst = _mm256_loadu_si256((const __m256i *)start);
+        blockLast = _mm256_loadu_si256((const __m256i *)(start + needleLength - 1));
+        mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last)));
+        
+        while(mask != 0)
+        {
+            bit = __builtin_ctz(mask);
+            if(memcmp(start + bit + 1, needle + 1, needleLength - 2) == 0)
+            {
+                return start + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    
+    return scanStringScalar(start, end, needle, needleLength);
+}
+#endif
+
+/* Reads fixed size lines from the pipe into the line ring until the end of
+ * the file, joining the pieces of lines that were split */
+void pipeReadFixed(ThreadParams *params)
+{
+    LineBuffer *line = ringReserve(&(params->ring));
+    size_t chunkLength;
+    
+    // Read each line from the pipe straight into a free ring slot
+    line->length = 0;
+    while(1)
+    {
+        lineReserve(line, line->length + MAX_LINE_SIZE);
+        if(!pipeReadFull(params, line->data + line->length, MAX_LINE_SIZE))
+        {
+            fprintf(stderr, "Error reading from pipe: unexpected end of data\n");
+            exit(4);
+        }
+        chunkLength = strnlen(line->data + line->length, MAX_LINE_SIZE - 1);
+        
+        // Check if file has finished reading, the slot is reused for the end marker
+        if(chunkLength == 0)
+        {
+            if(line->length > 0)
+            {
+                params->stages[STAGE_B].lines++;
+                params->stages[STAGE_B].bytes += line->length;
+                ringCommit(&(params->ring));
+            }
+            else
+            {
+                sem_post(&(params->ring.emptySlots));
+            }
+            break;
+        }
+        
+        // A full piece without a newline is continued in the next write
+        line->length += chunkLength;
+        if(chunkLength == MAX_LINE_SIZE - 1 && line->data[line->length - 1] != '\n')
+        {
+            continue;
+        }
+        line->data[line->length] = '\0';
+        
+        if(params->logLevel >= LOG_TRACE)
+        {
+            outputTrace(&(params->trace), "THREADB: Read line from pipe: ", 'B', line->data, 0);
+        }
+        
+        // Give access to thread
+        params->stages[STAGE_B].lines++;
+        params->stages[STAGE_B].bytes += line->length;
+        ringCommit(&(params->ring));
+        line = ringReserve(&(params->ring));
+        line->length = 0;
+    }
+}
+
+/* Reads length-prefixed frames from the pipe into the line ring until the end
+ * of the file, keeping any frames of the next file in the buffer */
+void pipeReadFramed(ThreadParams *params, PipeBatch *buffer)
+{
+    size_t result;
+    size_t offset = 0;
+    size_t available;
+    uint32_t length;
+    LineBuffer *line;
+    
+    while(1)
+    {
+        // Copy every complete frame into a free ring slot
+        while(buffer->used - offset >= sizeof(length))
+        {
+            memcpy(&length, buffer->data + offset, sizeof(length));
+            available = buffer->used - offset - sizeof(length);
+            if(available < length && sizeof(length) + length <= sizeof(buffer->data))
+            {
+                break;
+            }
+            
+            // A zero length frame ends the file
+            if(length == 0)
+            {
+                offset += sizeof(length);
+                memmove(buffer->data, buffer->data + offset, buffer->used - offset);
+                buffer->used -= offset;
+                return;
+            }
+            
+            line = ringReserve(&(params->ring));
+            lineReserve(line, (size_t)length + 1);
+            if(available >= length)
+            {
+                memcpy(line->data, buffer->data + offset + sizeof(length), length);
+                offset += sizeof(length) + length;
+            }
+            else
+            {
+                // Frames longer than the buffer are read straight into the slot
+                memcpy(line->data, buffer->data + offset + sizeof(length), available);
+                if(!pipeReadFull(params, line->data + available, length - available))
+                {
+                    fprintf(stderr, "Error reading from pipe: unexpected end of data\n");
+                    exit(4);
+                }
+                offset = buffer->used;
+            }
+            line->length = length;
+            line->data[length] = '\0';
+            
+            if(params->logLevel >= LOG_TRACE)
+            {
+                outputTrace(&(params->trace), "THREADB: Read line from pipe: ", 'B', line->data, 0);
+            }
+            
+            // Give access to thread
+            params->stages[STAGE_B].lines++;
+            params->stages[STAGE_B].bytes += length;
+            ringCommit(&(params->ring));
+        }
+        
+        // Keep any partial frame for the next read
+        memmove(buffer->data, buffer->data + offset, buffer->used - offset);
+        buffer->used -= offset;
+        offset = 0;
+        
+        result = pipeRead(params, buffer->data + buffer->used, sizeof(buffer->data) - buffer->used);
+        if(result == 0)
+        {
+            fprintf(stderr, "Error reading from pipe: unexpected end of data\n");
+            exit(4);
+        }
+        
+        buffer->used += result;
+    }
+}
+
+
+/* This thread reads from the line ring and outputs non-header to a file */
+void *ThreadC(void *params) 
+{
+    // Initialise variables
+    ThreadParams *C_thread_params = (ThreadParams *)(params);
+    FileJob *job;
+    LineBuffer *batch[FILTER_BATCH_SIZE];
+    LineBuffer *line;
+    Filter *dropped;
+    int count, endOfFile, j;
+    StageStats *stage = &(C_thread_params->stages[STAGE_C]);
+    uint64_t start;
+    Uring uring;
+    int useUring;
+    Writer writer;
+    Codec codec;
+    int syncMode;
+    unsigned long long syncEvery;
+    FILE* writeTxt;
+    int i;
+    
+    writerInit(&writer);
+    uring.fd = -1;
+    if(C_thread_params->engine == ENGINE_URING)
+    {
+        uringInit(&uring);
+    }
+    
+    for(i = 0; i < C_thread_params->jobCount; i++)
+    {
+        job = &(C_thread_params->jobs[i]);
+        
+        // Start every filter afresh for the new file
+        for(j = 0; j < C_thread_params->filterCount; j++)
+        {
+            if(C_thread_params->filters[j].reset != NULL)
+            {
+                C_thread_params->filters[j].reset(&(C_thread_params->filters[j]));
+            }
+        }
+        
+        // Get name of output file from user or from the command line
+        timedWait(&(stage->wait), &(C_thread_params->sem_C_to_A));
+        if(C_thread_params->interactive)
+        {
+            inputFilename(&writeTxt,job->writeFilename,"w","output");
+        }
+        else
+        {
+            openJobFile(C_thread_params, &writeTxt, job->writeFilename, "w");
+        }
+        syncMode = (job->syncMode == SYNC_DEFAULT) ? C_thread_params->syncMode : job->syncMode;
+        syncEvery = (job->syncMode == SYNC_DEFAULT) ? C_thread_params->syncEvery : job->syncEvery;
+        codecStart(&codec, &writeTxt, job->writeFilename, 1, syncMode, C_thread_params->level, CODEC_NONE);
+        
+        if(i == 0 && C_thread_params->logLevel >= LOG_INFO)
+        {
+            outputHeader();
+            outputLine("SUCCESS: Program started transferring data", 'Y');
+            outputDivider();
+            fflush(stdout);
+        }
+        
+        // In zero-copy and parallel modes the body is written straight to the output file
+        C_thread_params->writeFd = fileno(writeTxt);
+        useUring = (uring.fd >= 0 && !C_thread_params->zeroCopy && uringOpenFile(&uring, fileno(writeTxt)) == 0);
+        
+        // Lines kept by the filters are gathered by the writer unless io_uring writes them
+        if(!useUring && writerOpen(&writer, fileno(writeTxt), syncMode, syncEvery, C_thread_params->direct) < 0
+            && C_thread_params->logLevel >= LOG_INFO)
+        {
+            outputVar("WARNING: O_DIRECT is not supported by ", 'R', job->writeFilename);
+        }
+        if(C_thread_params->zeroCopy)
+        {
+            sem_post(&(C_thread_params->sem_B_to_C));
+        }
+        sem_post(&(C_thread_params->sem_A_to_B));
+        
+        // Take batches of lines until the empty end marker arrives
+        endOfFile = 0;
+        while(!endOfFile)
+        {
+            count = ringPeekBatch(&(C_thread_params->ring), batch, FILTER_BATCH_SIZE);
+            for(j = 0; j < count && !endOfFile; j++)
+            {
+                line = batch[j];
+                if(line->length == 0)
+                {
+                    endOfFile = 1;
+                    break;
+                }
+                
+                // Run the line through the whole chain and write it if it is kept
+                stage->lines++;
+                dropped = runFilters(C_thread_params, line);
+                if(dropped == NULL)
+                {
+                    start = timerStart(&(stage->file));
+                    if(useUring)
+                    {
+                        uringWrite(&uring, line->data, line->length);
+                    }
+                    else
+                    {
+                        writerWrite(&writer, line->data, line->length);
+                    }
+                    timerStop(&(stage->file), start);
+                    stage->bytes += line->length;
+                }
+                
+                if(C_thread_params->logLevel >= LOG_TRACE)
+                {
+                    if(dropped == NULL)
+                    {
+                        outputTrace(&(C_thread_params->trace), "THREADC: Output line to file: ", 'G', line->data, 1);
+                    }
+                    else
+                    {
+                        outputTrace(&(C_thread_params->trace), dropped->dropMessage, dropped->dropColor, line->data, 1);
+                    }
+                }
+                
+                // In lockstep mode let ThreadA read the next line
+                if(C_thread_params->lockstep)
+                {
+                    sem_post(&(C_thread_params->sem_A_to_B));
+                }
+            }
+            
+            // Give the slots back to ThreadB, with the end marker if it was reached,
+            // and keep any lines of the next file for its first batch
+            ringReleaseBatch(&(C_thread_params->ring), endOfFile ? j + 1 : j);
+        }
+        
+        // Close file
+        start = timerStart(&(stage->file));
+        if(useUring)
+        {
+            uringFlush(&uring);
+            uringCloseFile(&uring);
+            syncFile(fileno(writeTxt), syncMode);
+        }
+        else
+        {
+            writerClose(&writer);
+        }
+        fclose(writeTxt);
+        codecFinish(&codec, C_thread_params->logLevel);
+        timerStop(&(stage->file), start);
+        
+        if(C_thread_params->logLevel >= LOG_TRACE)
+        {
+            outputLine("SUCCESS: Closed output file", 'Y');
+        }
+        
+        // Output completion message
+        if(C_thread_params->logLevel >= LOG_INFO)
+        {
+            outputVar("SUCCESS: Read all data from ", 'Y', job->readFilename);
+            outputVar("SUCCESS: Output all data to ", 'Y', job->writeFilename);
+            for(j = 0; j < C_thread_params->filterCount; j++)
+            {
+                if(C_thread_params->filters[j].report != NULL)
+                {
+                    C_thread_params->filters[j].report(&(C_thread_params->filters[j]));
+                }
+            }
+        }
+    }
+    
+    uringDestroy(&uring);
+    free(writer.buffer);
+    
+    return NULL;
+}
+
+/* Returns the monotonic clock in nanoseconds */
+uint64_t clockNs()
+{
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Returns the start time of a timed call, or 0 when the statistic is off */
+uint64_t timerStart(TimeStat *stat)
+{
+    return stat->enabled ? clockNs() : 0;
+}
+
+/* Adds the time since start to a statistic */
+void timerStop(TimeStat *stat, uint64_t start)
+{
+    uint64_t elapsed;
+    int bucket;
+    
+    if(!stat->enabled)
+    {
+        return;
+    }
+    
+    elapsed = clockNs() - start;
+    bucket = (elapsed == 0) ? 0 : 64 - __builtin_clzll(elapsed);
+    if(bucket >= TIME_BUCKETS)
+    {
+        bucket = TIME_BUCKETS - 1;
+    }
+    
+    stat->count++;
+    stat->totalNs += elapsed;
+    stat->buckets[bucket]++;
+    if(elapsed > stat->maxNs)
+    {
+        stat->maxNs = elapsed;
+    }
+}
+
+/* Waits on a semaphore and adds the time blocked to a statistic */
+void timedWait(TimeStat *stat, sem_t *sem)
+{
+    uint64_t start = timerStart(stat);
+    
+    sem_wait(sem);
+    timerStop(stat, start);
+}
+
+/* Writes the statistics of every thread to the stats file as one line of JSON */
+void outputStats(ThreadParams *params, int final)
+{
+    FILE *file = params->statsFile;
+    StageStats *stage;
+    int i;
+    
+    // Counters are read while the threads run, so a snapshot taken on
+    // SIGUSR1 may be a few calls out between stages
+    fprintf(file, "{\"final\":%s,\"elapsed_ns\":%llu,\"stages\":[",
+        final ? "true" : "false", (unsigned long long)(clockNs() - params->startNs));
+    for(i = 0; i < STAGE_COUNT; i++)
+    {
+        stage = &(params->stages[i]);
+        fprintf(file, "%s{\"stage\":\"%s\",\"lines\":%llu,\"bytes\":%llu,",
+            (i > 0) ? "," : "", stage->name, stage->lines, stage->bytes);
+        outputTimeStat(file, "wait", &(stage->wait));
+        fputc(',', file);
+        outputTimeStat(file, "pipe", &(stage->pipe));
+        fputc(',', file);
+        outputTimeStat(file, "file", &(stage->file));
+        fputc('}', file);
+    }
+    fprintf(file, "]}\n");
+    fflush(file);
+}
+
+/* Writes one timing statistic as a JSON member */
+void outputTimeStat(FILE *file, const char *name, TimeStat *stat)
+{
+    int i, first = 1;
+    
+    fprintf(file, "\"%s\":{\"count\":%llu,\"total_ns\":%llu,\"max_ns\":%llu,\"histogram\":[",
+        name, stat->count, stat->totalNs, stat->maxNs);
+    
+    // Each pair is the bound of a bucket in nanoseconds and its count
+    for(i = 0; i < TIME_BUCKETS; i++)
+    {
+        if(stat->buckets[i] > 0)
+        {
+            fprintf(file, "%s[%llu,%llu]", first ? "" : ",", 1ULL << i, stat->buckets[i]);
+            first = 0;
+        }
+    }
+    fprintf(file, "]}");
+}
+
+/* This thread writes the statistics each time the program receives SIGUSR1 */
+void *statsThread(void *params)
+{
+    // Initialise variables
+    ThreadParams *stats_params = (ThreadParams *)(params);
+    sigset_t signals;
+    int signal;
+    
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    
+    // Main cancels this thread while it waits for the next signal
+    while(sigwait(&signals, &signal) == 0)
+    {
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        outputStats(stats_params, 0);
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    }
+    
+    return NULL;
+}
+
+/* Adds an empty filter to the end of the chain */
+Filter *addFilter(ThreadParams *params)
+{
+    Filter *filter;
+    
+    if(params->filterCount == MAX_FILTERS)
+    {
+        fprintf(stderr, "Error: more than %d filters\n", MAX_FILTERS);
+        exit(1);
+    }
+    
+    filter = &(params->filters[params->filterCount++]);
+    memset(filter, 0, sizeof(*filter));
+    filter->delimiter = ' ';
+    return filter;
+}
+
+/* Runs a line through every filter in order, returns the filter that
+ * dropped it or NULL if it is kept */
+Filter *runFilters(ThreadParams *params, LineBuffer *line)
+{
+    Filter *filter = params->filters;
+    Filter *end = params->filters + params->filterCount;
+    
+    for(; filter < end; filter++)
+    {
+        if(filter->apply(filter, line) == FILTER_DROP)
+        {
+            return filter;
+        }
+    }
+    
+    return NULL;
+}
+
+/* Sets up the filter that drops lines up to and including END_HEADER */
+void filterHeaderInit(Filter *filter)
+{
+    filter->apply = filterHeader;
+    filter->reset = filterHeaderReset;
+    filterHeaderReset(filter);
+}
+
+int filterHeader(Filter *filter, LineBuffer *line)
+{
+    if(filter->headerPassed)
+    {
+        return FILTER_KEEP;
+    }
+    
+    // Check if current line holds the end header flag
+    if(scanString(line->data, line->data + line->length, END_HEADER, END_HEADER_LENGTH) != NULL)
+    {
+        filter->headerPassed = 1;
+        filter->dropMessage = "THREADC: Reached header flag: ";
+        filter->dropColor = 'C';
+    }
+    
+    return FILTER_DROP;
+}
+
+void filterHeaderReset(Filter *filter)
+{
+    filter->headerPassed = 0;
+    filter->dropMessage = "THREADC: Skipped header line: ";
+    filter->dropColor = 'R';
+}
+
+/* Sets up the filter that keeps lines matching an extended regular expression */
+void filterRegexInit(Filter *filter, const char *pattern)
+{
+    char error[256];
+    int result;
+    
+    result = regcomp(&(filter->regex), pattern, REG_EXTENDED | REG_NOSUB | REG_NEWLINE);
+    if(result != 0)
+    {
+        regerror(result, &(filter->regex), error, sizeof(error));
+        fprintf(stderr, "Error in regular expression %s: %s\n", pattern, error);
+        exit(1);
+    }
+    
+    filter->apply = filterRegex;
+    filter->dropMessage = "THREADC: Skipped unmatched line: ";
+    filter->dropColor = 'M';
+}
+
+int filterRegex(Filter *filter, LineBuffer *line)
+{
+    // Slots always end in a null so the line can be matched where it is
+    return (regexec(&(filter->regex), line->data, 0, NULL, 0) == 0) ? FILTER_KEEP : FILTER_DROP;
+}
+
+/* Sets up the filter that keeps a list of fields such as 1,3-5,7- */
+void filterFieldsInit(Filter *filter, const char *list)
+{
+    FieldRange *range;
+    char *end;
+    
+    while(*list != '\0')
+    {
+        if(filter->rangeCount == MAX_FIELD_RANGES)
+        {
+            fprintf(stderr, "Error: more than %d field ranges\n", MAX_FIELD_RANGES);
+            exit(1);
+        }
+        range = &(filter->ranges[filter->rangeCount++]);
+        
+        // Each range is N, N-M, N- or -M
+        range->first = (*list == '-') ? 1 : (int)strtol(list, &end, 10);
+        if(*list != '-')
+        {
+            list = end;
+        }
+        range->last = range->first;
+        if(*list == '-')
+        {
+            list++;
+            range->last = (*list == ',' || *list == '\0') ? INT_MAX : (int)strtol(list, &end, 10);
+            if(range->last != INT_MAX)
+            {
+                list = end;
+            }
+        }
+        
+        if(range->first < 1 || range->last < range->first || (*list != ',' && *list != '\0'))
+        {
+            fprintf(stderr, "Error: invalid field list\n");
+            exit(1);
+        }
+        if(*list == ',')
+        {
+            list++;
+        }
+    }
+    
+    filter->apply = filterFields;
+}
+
+int filterFields(Filter *filter, LineBuffer *line)
+{
+    char *read = line->data;
+    char *write = line->data;
+    char *end = line->data + line->length;
+    char *fieldEnd;
+    int field, i, first = 1, newline = 0;
+    
+    if(end > read && end[-1] == '\n')
+    {
+        end--;
+        newline = 1;
+    }
+    
+    // Kept fields are moved down over the line, which never grows
+    for(field = 1; read <= end; field++)
+    {
+        fieldEnd = memchr(read, filter->delimiter, end - read);
+        if(fieldEnd == NULL)
+        {
+            fieldEnd = end;
+        }
+        
+        for(i = 0; i < filter->rangeCount; i++)
+        {
+            if(field >= filter->ranges[i].first && field <= filter->ranges[i].last)
+            {
+                if(!first)
+                {
+                    *write++ = filter->delimiter;
+                }
+                memmove(write, read, fieldEnd - read);
+                write += fieldEnd - read;
+                first = 0;
+                break;
+            }
+        }
+        
+        read = fieldEnd + 1;
+    }
+    
+    if(newline)
+    {
+        *write++ = '\n';
+    }
+    *write = '\0';
+    line->length = write - line->data;
+    
+    return FILTER_KEEP;
+}
+
+/* Sets up the filter that reports the CRC-32 of each file */
+void filterChecksumInit(Filter *filter)
+{
+    uint32_t value;
+    int i, bit;
+    
+    // Tables of the reflected IEEE polynomial used by zlib and Ethernet,
+    // table n advances a byte that is followed by n more
+    for(i = 0; i < 256; i++)
+    {
+        value = i;
+        for(bit = 0; bit < 8; bit++)
+        {
+            value = (value & 1) ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+        }
+        filter->crcTable[0][i] = value;
+    }
+    for(i = 0; i < 256; i++)
+    {
+        for(bit = 1; bit < 8; bit++)
+        {
+            value = filter->crcTable[bit - 1][i];
+            filter->crcTable[bit][i] = filter->crcTable[0][value & 0xFF] ^ (value >> 8);
+        }
+    }
+    
+    filter->apply = filterChecksum;
+    filter->reset = filterChecksumReset;
+    filter->report = filterChecksumReport;
+    filterChecksumReset(filter);
+}
+
+int filterChecksum(Filter *filter, LineBuffer *line)
+{
+    uint32_t (*table)[256] = filter->crcTable;
+    const unsigned char *data = (const unsigned char *)line->data;
+    const unsigned char *end = data + line->length;
+    uint32_t crc = ~filter->crc;
+    uint32_t low, high;
+    
+    // Eight bytes at a time on little-endian hosts, then the rest one at a time
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for(; end - data >= 8; data += 8)
+    {
+        memcpy(&low, data, sizeof(low));
+        memcpy(&high, data + 4, sizeof(high));
+        low ^= crc;
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^
+            table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+            table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^
+            table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+    }
+#endif
+    for(; data < end; data++)
+    {
+        crc = table[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+    }
+    
+    filter->crc = ~crc;
+    filter->checksumBytes += line->length;
+    return FILTER_KEEP;
+}
+
+void filterChecksumReset(Filter *filter)
+{
+    filter->crc = 0;
+    filter->checksumBytes = 0;
+}
+
+void filterChecksumReport(Filter *filter)
+{
+    char value[64];
+    
+    snprintf(value, sizeof(value), "%08x (%llu bytes)", filter->crc, filter->checksumBytes);
+    outputVar("SUCCESS: CRC-32 of output: ", 'Y', value);
+}
+
+/* Adds an input and output file pair to the list of jobs */
+void addJob(ThreadParams *params, const char *readFilename, const char *writeFilename)
+{
+    FileJob *jobs = realloc(params->jobs, (params->jobCount + 1) * sizeof(FileJob));
+    if(jobs == NULL)
+    {
+        perror("Error allocating jobs");
+        exit(1);
+    }
+    
+    params->jobs = jobs;
+    snprintf(jobs[params->jobCount].readFilename, MAX_FILENAME_SIZE, "%s", readFilename);
+    snprintf(jobs[params->jobCount].writeFilename, MAX_FILENAME_SIZE, "%s", writeFilename);
+    jobs[params->jobCount].syncMode = SYNC_DEFAULT;
+    jobs[params->jobCount].syncEvery = 0;
+    params->jobCount++;
+}
+
+/* Adds every "input output" pair listed in a manifest file to the list of jobs */
+void loadManifest(ThreadParams *params, const char *filename)
+{
+    char line[2 * MAX_FILENAME_SIZE + 32];
+    char readFilename[MAX_FILENAME_SIZE], writeFilename[MAX_FILENAME_SIZE];
+    char sync[32];
+    FileJob *job;
+    int fields;
+    int lineNumber = 0;
+    FILE *manifest;
+    
+    manifest = (strcmp(filename, "-") == 0) ? stdin : fopen(filename, "r");
+    if(manifest == NULL)
+    {
+        perror(filename);
+        exit(1);
+    }
+    
+    while(fgets(line, sizeof(line), manifest) != NULL)
+    {
+        lineNumber++;
+        
+        // Skip blank lines and comments
+        if(sscanf(line, "%4095s", readFilename) != 1 || readFilename[0] == '#')
+        {
+            continue;
+        }
+        
+        fields = sscanf(line, "%4095s %4095s %31s", readFilename, writeFilename, sync);
+        if(fields < 2)
+        {
+            fprintf(stderr, "%s:%d: expected an input and an output file\n", filename, lineNumber);
+            exit(1);
+        }
+        
+        // An optional third column sets the durability of this output
+        addJob(params, readFilename, writeFilename);
+        job = &(params->jobs[params->jobCount - 1]);
+        if(fields == 3 && parseSync(sync, &(job->syncMode), &(job->syncEvery)) < 0)
+        {
+            fprintf(stderr, "%s:%d: expected none, close or a number of MB after the files\n", filename, lineNumber);
+            exit(1);
+        }
+    }
+    
+    if(manifest != stdin)
+    {
+        fclose(manifest);
+    }
+}
+
+/* Opens a file named on the command line or in a manifest, "-" is stdin or stdout */
+void openJobFile(ThreadParams *params, FILE **file, const char *filename, const char *permission)
+{
+    if(strcmp(filename, "-") == 0)
+    {
+        *file = fdopen(dup(permission[0] == 'r' ? STDIN_FILENO : params->stdoutFd), permission);
+    }
+    else
+    {
+        *file = fopen(filename, permission);
+    }
+    
+    if(*file == NULL)
+    {
+        perror(filename);
+        exit(1);
+    }
+}
+
+/* Outputs the bytes per line and syscalls per MB of the pipe */
+void outputPipeStats(PipeStats *stats)
+{
+    char value[64];
+    double megabytes = stats->lineBytes / (1024.0 * 1024.0);
+    
+    // Spliced data is never split into lines
+    if(stats->lines == 0 && stats->pipeBytes > 0)
+    {
+        snprintf(value, sizeof(value), "%llu bytes in %lu splices",
+            stats->pipeBytes, stats->writes);
+        outputVar("PIPE: Spliced body: ", 'C', value);
+        return;
+    }
+    
+    if(stats->lines == 0 || megabytes == 0)
+    {
+        return;
+    }
+    
+    snprintf(value, sizeof(value), "%lu (%.1f bytes of text)", stats->lines,
+        (double)stats->lineBytes / stats->lines);
+    outputVar("PIPE: Lines sent: ", 'C', value);
+    snprintf(value, sizeof(value), "%.1f", (double)stats->pipeBytes / stats->lines);
+    outputVar("PIPE: Bytes per line: ", 'C', value);
+    snprintf(value, sizeof(value), "%.1f writes, %.1f reads",
+        stats->writes / megabytes, stats->reads / megabytes);
+    outputVar("PIPE: Syscalls per MB: ", 'C', value);
+}
+
+/* Sends lines through every transport and outputs their rate and latency */
+void benchTransports(ThreadParams *params, unsigned long lines)
+{
+    // Only the pipe counters and statistics used by pipeWrite and pipeRead are needed
+    memset(params->stages, 0, sizeof(params->stages));
+    memset(&(params->pipeStats), 0, sizeof(params->pipeStats));
+    
+    outputHeader();
+    benchTransport(params, TRANSPORT_PIPE, lines, "pipe between processes");
+    benchTransport(params, TRANSPORT_RING, lines, "ring between threads");
+    benchTransport(params, TRANSPORT_SHM, lines, "shm ring between processes");
+    outputFooter();
+}
+
+/* Sends lines one at a time through a transport and outputs the lines per
+ * second and latency seen by the reader */
+void benchTransport(ThreadParams *params, int transport, unsigned long lines, const char *name)
+{
+    char buffer[PIPE_BATCH_SIZE];
+    char message[64], value[160];
+    BenchRun run;
+    BenchLine line;
+    TimeStat latency;
+    pthread_t writerTid;
+    pid_t writerPid = -1;
+    size_t used = 0, offset, result;
+    unsigned long received = 0;
+    uint64_t start, elapsed;
+    
+    memset(&latency, 0, sizeof(latency));
+    latency.enabled = 1;
+    run.params = params;
+    run.lines = lines;
+    
+    params->transport = transport;
+    params->byteRing = NULL;
+    if(transport == TRANSPORT_PIPE)
+    {
+        if(pipe(params->pipeFile) < 0)
+        {
+            perror("Error creating pipe");
+            exit(1);
+        }
+    }
+    else
+    {
+        params->byteRing = byteRingCreate(transport == TRANSPORT_SHM);
+    }
+    
+    // The writer is a forked process for the pipe and shm ring and a thread for the ring
+    start = clockNs();
+    fflush(stdout);
+    if(transport == TRANSPORT_RING)
+    {
+        if(pthread_create(&writerTid, NULL, benchWriter, (void*)(&run)) != 0)
+        {
+            perror("Error creating threads: ");
+            exit(-1);
+        }
+    }
+    else
+    {
+        writerPid = fork();
+        if(writerPid < 0)
+        {
+            perror("Error creating writer process");
+            exit(1);
+        }
+        if(writerPid == 0)
+        {
+            if(transport == TRANSPORT_PIPE)
+            {
+                close(params->pipeFile[0]);
+            }
+            benchWriter(&run);
+            _exit(0);
+        }
+        if(transport == TRANSPORT_PIPE)
+        {
+            close(params->pipeFile[1]);
+        }
+    }
+    
+    // Read whole lines as they arrive and time each one from when it was sent
+    pinThread(params->cpus[1]);
+    while((result = pipeRead(params, buffer + used, sizeof(buffer) - used)) > 0)
+    {
+        used += result;
+        for(offset = 0; used - offset >= sizeof(line); offset += sizeof(line))
+        {
+            memcpy(&line, buffer + offset, sizeof(line));
+            timerStop(&latency, line.sentNs);
+            received++;
+        }
+        memmove(buffer, buffer + offset, used - offset);
+        used -= offset;
+    }
+    elapsed = clockNs() - start;
+    
+    if(transport == TRANSPORT_RING)
+    {
+        pthread_join(writerTid, NULL);
+    }
+    else
+    {
+        waitpid(writerPid, NULL, 0);
+    }
+    if(transport == TRANSPORT_PIPE)
+    {
+        close(params->pipeFile[0]);
+    }
+    else
+    {
+        byteRingDestroy(params->byteRing);
+        params->byteRing = NULL;
+    }
+    
+    if(received != lines)
+    {
+        fprintf(stderr, "Error: %s delivered %lu of %lu lines\n", name, received, lines);
+        exit(4);
+    }
+    
+    snprintf(message, sizeof(message), "BENCH: %s: ", name);
+    snprintf(value, sizeof(value), "%.0f lines/s", received * 1e9 / (elapsed > 0 ? elapsed : 1));
+    outputVar(message, 'C', value);
+    snprintf(value, sizeof(value), "mean %llu, p50 <= %llu, p99 <= %llu, max %llu ns",
+        (unsigned long long)(latency.totalNs / latency.count),
+        (unsigned long long)timeStatPercentile(&latency, 0.5),
+        (unsigned long long)timeStatPercentile(&latency, 0.99),
+        (unsigned long long)latency.maxNs);
+    outputVar("BENCH:   latency: ", 'C', value);
+}
+
+/* This thread or process writes the benchmark lines */
+void *benchWriter(void *run)
+{
+    BenchRun *benchRun = (BenchRun *)(run);
+    BenchLine line;
+    unsigned long i;
+    
+    pinThread(benchRun->params->cpus[0]);
+    memset(line.text, 'x', sizeof(line.text));
+    line.text[sizeof(line.text) - 1] = '\n';
+    
+    // Send each line on its own, as ThreadA does in lockstep mode
+    for(i = 0; i < benchRun->lines; i++)
+    {
+        line.sentNs = clockNs();
+        pipeWrite(benchRun->params, (char *)&line, sizeof(line));
+    }
+    pipeClose(benchRun->params);
+    
+    return NULL;
+}
+
+/* Returns the upper bound of the time under which a fraction of a statistic falls */
+uint64_t timeStatPercentile(TimeStat *stat, double fraction)
+{
+    unsigned long long seen = 0;
+    int bucket;
+    
+    // Bucket b holds times below 2^b ns, the last one holds everything longer
+    for(bucket = 0; bucket < TIME_BUCKETS - 1; bucket++)
+    {
+        seen += stat->buckets[bucket];
+        if(seen >= fraction * stat->count)
+        {
+            // No time is above the longest one recorded
+            return ((1ULL << bucket) < stat->maxNs) ? 1ULL << bucket : stat->maxNs;
+        }
+    }
+    return stat->maxNs;
+}
+
+/* Outputs the command line usage */
+void outputUsage(const char *program)
+{
+    fprintf(stderr,
+        "Usage: %s [-i input] [-o output] [-l manifest] [-d depth] [-f framed|fixed] [-z] [-m] [-p workers] [-e stdio|uring]\n"
+        "       [-y none|close|MB] [-D] [-x level] [-Z gzip|zstd]\n"
+        "       [-T pipe|ring|shm] [-a a,b] [-B lines] [-g regex] [-c list] [-t char] [-k]\n"
+        "       [-q|-v] [-r rate] [-s file]\n"
+        "  -i file   input file, - for stdin\n"
+        "  -o file   output file, - for stdout\n"
+        "  -l file   process every \"input output\" pair listed in a manifest file\n"
+        "  -d depth  number of line slots between ThreadB and ThreadC (default %d),\n"
+        "            0 runs the threads in lockstep one line at a time\n"
+        "  -f mode   framed packs length-prefixed lines into %d byte writes (default),\n"
+        "            fixed writes every line as %d bytes\n"
+        "  -z        splice the body after the header through the pipe without copying\n"
+        "  -m        map the input file into memory instead of reading it with fgets\n"
+        "  -p count  copy the body with a pool of workers using pwrite, 0 for one per CPU\n"
+        "  -e engine stdio reads and writes files with stdio (default), uring keeps\n"
+        "            %d reads or writes of %d bytes in flight with io_uring\n"
+        "  -y mode   durability of each output: none (default), close to fsync it when\n"
+        "            done, or a number N to fdatasync every N MB and when done\n"
+        "  -D        write output files with O_DIRECT\n"
+        "  -x level  compression level of .gz (0-9, default 6) and .zst (1-19, default 3) outputs\n"
+        "  -Z codec  decompress inputs that cannot be read ahead, such as stdin, with gzip\n"
+        "            or zstd, as their magic bytes cannot be checked\n"
+        "  -T mode   pipe joins ThreadA and ThreadB with a pipe (default), ring with a\n"
+        "            %d byte ring in memory, shm with the ring in a shm_open segment\n"
+        "  -a a,b    pin ThreadA to CPU a and ThreadB to CPU b\n"
+        "  -B lines  send lines through each transport and report their rate and latency\n"
+        "  -g regex  keep only lines matching an extended regular expression\n"
+        "  -c list   keep only the listed fields of each line, such as 1,3-5,7-\n"
+        "  -t char   field delimiter for -c (default space)\n"
+        "  -k        report the CRC-32 of the lines that reach this point of the chain\n"
+        "  -q        show errors only\n"
+        "  -v        trace every line through each thread\n"
+        "  -r rate   trace at most rate lines per second (default %d), 0 for no limit\n"
+        "  -s file   write per-thread counters and timings as JSON to file, - for stderr,\n"
+        "            at the end of the run and on SIGUSR1\n",
+        program, DEFAULT_RING_DEPTH, PIPE_BATCH_SIZE, MAX_LINE_SIZE, URING_DEPTH, URING_BUFFER_SIZE,
+        TRANSPORT_RING_SIZE, DEFAULT_TRACE_RATE);
+}
+
+/* Outputs the welcome banner to the console */
+void outputWelcome()
+{
+    printf("\x1B[33m");
+    printf("                                             _______________________\n");
+    printf("   _______________________-------------------                       `\\\n");
+    printf(" /:--__                                                              |\n");
+    printf("||< > |                                   ___________________________/\n");
+    printf("| \\__/_________________-------------------                         |\n");
+    printf("|                                                                  |\n");
+    printf(" |                                                                  |\n");
+    printf(" |                       THE SUPER FILE READER                      |\n");
+    printf(" |                                                                  |\n");
+    printf("  |                         Read from files,                         |\n");
+    printf("  |                          Write to files,                         |\n");
+    printf("  |                          Multithreaded,                          |\n");
+    printf("  |                  And so many more great features                  |\n");
+    printf("   |                                                                  |\n");
+    printf("   |                 By Braden Payne and Jack Romanous                |\n");
+    printf("   |                     (12947697)        (12551519)                |\n");
+    printf("  |                                              ____________________|_\n");
+    printf("  |  ___________________-------------------------                      `\\\n");
+    printf("  |/`--_                                                                 |\n");
+    printf("  ||[ ]||                                            ___________________/\n");
+    printf("   \\===/___________________--------------------------\n\n");
+    printf("\x1B[0m");
+}
+
+/* Outputs the header line to the console */
+void outputHeader()
+{
+    printf("╔═════════════════════════════════════════════════════════════════════════════╗\n");
+}
+
+/* Outputs the dividing line to the console */
+void outputDivider()
+{
+    printf("╠═════════════════════════════════════════════════════════════════════════════╣\n");
+}
+
+/* Outputs the footer line to the console */
+void outputFooter()
+{
+    printf("╚═════════════════════════════════════════════════════════════════════════════╝\n");
+}
+
+/* Outputs a message line to the console */
+void outputLine(char *message, const char color)
+{
+    outputVar(message, color, "");
+}
+
+/* Outputs a message with variable line to the console */
+void outputVar(char *message, const char color, char *value)
+{
+    char buffer[OUTPUT_LINE_SIZE];
+    int length = formatLine(buffer, message, color, value);
+    
+    fwrite(buffer, 1, length, stdout);
+}
+
+/* Outputs a trace message with variable line unless the trace rate has been
+ * reached this second, optionally followed by the dividing line */
+void outputTrace(TraceSink *trace, char *message, const char color, const char *value, int divider)
+{
+    char buffer[OUTPUT_LINE_SIZE];
+    struct timespec now;
+    int length;
+    
+    pthread_mutex_lock(&(trace->lock));
+    
+    // Start counting again each second
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(now.tv_sec != trace->windowStart)
+    {
+        trace->windowStart = now.tv_sec;
+        trace->windowCount = 0;
+    }
+    
+    if(trace->rate > 0 && trace->windowCount >= trace->rate)
+    {
+        trace->dropped++;
+        pthread_mutex_unlock(&(trace->lock));
+        return;
+    }
+    trace->windowCount++;
+    
+    length = formatLine(buffer, message, color, value);
+    fwrite(buffer, 1, length, stdout);
+    if(divider)
+    {
+        outputDivider();
+    }
+    
+    pthread_mutex_unlock(&(trace->lock));
+}
+
+/* Formats a message with variable line for the console, returns its length */
+int formatLine(char *buffer, const char *message, const char color, const char *value)
+{
+    int length = sprintf(buffer, "║ %s%s", colorCode(color), message);
+    int textLength = strlen(message);
+    
+    // Copy the value without its line ending, leaving room for the padding
+    for(; *value != '\0' && length < OUTPUT_LINE_SIZE - 128; value++)
+    {
+        if(*value != '\n' && *value != '\r')
+        {
+            buffer[length++] = *value;
+            textLength++;
+        }
+    }
+    
+    length += sprintf(buffer + length, "\x1B[0m%*s ║\n", textLength < 75 ? 75 - textLength : 0, "");
+    return length;
+}
+
+/* Inputs a filename from the user */
+void inputFilename(FILE **file, char *filename, char *permission, char *purpose)
+{
+    int spacesTop = 20 - strlen(purpose);
+    int spacesBot = 30 - strlen(purpose);
+    
+    // Prompt user for the path to the file they want to select
+    printf(
+        "\n\n"
+        "╔════════════════════════════════════════╗\n"
+        "║ Please enter the filename of the file  ║\n"
+        "║ you would like to %s%*s ║\n"
+        "║                                        ║\n"
+        "║ eg. %s.txt%*s ║\n"
+        "╠════════════════════════════════════════╝\n"
+        "╚ ► ",purpose,spacesTop,"",purpose,spacesBot,"");
+    fflush(stdout);
+    
+    scanf("%s", filename);
+    *file = fopen(filename, permission);
+    
+    // Check if the file is unreadable
+    while(*file == NULL)
+    {
+        // Print error message and re-ask for the file path
+        printf(
+            "╔════════════════════════════════════════╗\n"
+            "║ \x1B[31mError: File not found                 \x1B[0m ║\n"
+            "╠════════════════════════════════════════╣\n"
+            "║ Please select a valid filename         ║\n"
+            "╠════════════════════════════════════════╝\n"
+            "╚ ► ");
+        fflush(stdout);
+        scanf("%s", filename);
+        *file = fopen(filename, permission);
+    }
+}
+
+/* Changes the console color */
+void changeColor(const char color)
+{
+    printf("%s", colorCode(color));
+}
+
+/* Returns the escape code for a console color */
+const char *colorCode(const char color)
+{
+    switch(color)
+    {
+        case 'R':
+            return "\x1B[31m";
+        case 'G':
+            return "\x1B[32m";
+        case 'Y':
+            return "\x1B[33m";
+        case 'B':
+            return "\x1B[34m";
+        case 'M':
+            return "\x1b[35m";
+        case 'C':
+            return "\x1b[36m";
+    }
+    
+    return "";
 }
\ No newline at end of file